@@ -0,0 +1,94 @@
+#include "all_assoc.hpp"
+#include <algorithm>
+
+int AllAssocSimulator::setup(uint64_t b, uint64_t c_min, uint64_t c_max, uint64_t s_max) {
+    this->b = b;
+    this->c_min = c_min;
+    this->c_max = c_max;
+    this->s_max = s_max;
+    accesses = 0;
+    groups.clear();
+    if (c_min > c_max || c_max < b || s_max > 16) {
+        return 1;
+    }
+
+    // Index width k holds every S with c_min <= b + k + S <= c_max
+    for (uint64_t k = 0; k + b <= c_max; k++) {
+        uint64_t s_lo = c_min > b + k ? c_min - b - k : 0;
+        uint64_t s_hi = std::min(s_max, c_max - b - k);
+        if (s_lo > s_hi) {
+            continue;
+        }
+        groups.push_back(IndexGroup());
+        IndexGroup &group = groups.back();
+        group.index_bits = k;
+        group.s_min = s_lo;
+        group.stack.init(k, s_hi);
+        for (uint64_t s = s_lo; s <= s_hi; s++) {
+            group.live.push_back(std::vector<uint32_t>((uint64_t)1 << k, (uint32_t)1 << s));
+            group.hits.push_back(0);
+        }
+    }
+    return groups.empty();
+}
+
+void AllAssocSimulator::access(uint64_t addr) {
+    accesses++;
+    uint64_t block_addr = addr >> b;
+    for (IndexGroup &group : groups) {
+        CacheLevel &stack = group.stack;
+        uint64_t tag = block_addr >> group.index_bits;
+        uint64_t index = block_addr & (((uint64_t)1 << group.index_bits) - 1);
+
+        int way = stack.lookup(index, tag);
+        if (way == -1) {
+            // A miss at every associativity
+            way = stack.free_way(index);
+            if (way == -1) way = stack.back_way(index);
+            stack.fill(index, way, tag, false);
+            stack.to_front(index, way);
+            continue;
+        }
+
+        uint32_t distance = stack.ranks[stack.base(index) + way];
+        uint32_t used = stack.used[index];
+        for (size_t i = 0; i < group.hits.size(); i++) {
+            uint32_t &live = group.live[i][index];
+            if (distance >= live) {
+                continue;
+            }
+            group.hits[i]++;
+            // Same retirement rule as Simulator::l1_promote()
+            if (distance == used - 1 && used + 2 <= live) {
+                live = used + 1;
+            }
+        }
+        stack.to_front(index, way);
+    }
+}
+
+void AllAssocSimulator::finish(std::vector<all_assoc_result_t> *results) {
+    results->clear();
+    double dram_time = DRAM_AT + DRAM_AT_PER_WORD * ((uint64_t)1 << b) / WORD_SIZE;
+    for (uint64_t c = c_min; c <= c_max; c++) {
+        // Groups run from narrow to wide index, so walk them backwards for
+        // ascending associativity
+        for (size_t g = groups.size(); g-- > 0; ) {
+            const IndexGroup &group = groups[g];
+            uint64_t s = c - b - group.index_bits;
+            if (c < b + group.index_bits || s < group.s_min || s - group.s_min >= group.hits.size()) {
+                continue;
+            }
+            all_assoc_result_t result;
+            result.c = c;
+            result.s = s;
+            result.hits = group.hits[s - group.s_min];
+            result.misses = accesses - result.hits;
+            result.hit_ratio = 1.0 * result.hits / accesses;
+            result.miss_ratio = 1 - result.hit_ratio;
+            double hit_time = L1_HIT_TIME_CONST + (s * L1_HIT_TIME_PER_S);
+            result.avg_access_time = hit_time + result.miss_ratio * 1.0 * dram_time;
+            results->push_back(result);
+        }
+    }
+}
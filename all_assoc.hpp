@@ -0,0 +1,55 @@
+#ifndef ALL_ASSOC_HPP
+#define ALL_ASSOC_HPP
+
+#include "simulator.hpp"
+#include <vector>
+
+typedef struct all_assoc_result {
+    uint64_t c;
+    uint64_t s;
+    uint64_t hits;
+    uint64_t misses;
+    double hit_ratio;
+    double miss_ratio;
+    double avg_access_time;
+} all_assoc_result_t;
+
+// Single-pass L1 simulation for every (C, S) with C in [c_min, c_max] and S
+// in [0, s_max] at one block size (Hill and Smith's all-associativity
+// simulation). The L1 is MRU-insert/LRU-evict, so for a fixed number of sets
+// each set's LRU stack gives the hit or miss of every associativity at once:
+// an access hits in a 2^S-way cache when its stack distance is below 2^S.
+// One stack per distinct index width covers all the sizes.
+//
+// The only per-configuration state is the live way count of each set, which
+// follows the L1 way retirement in Simulator::l1_promote(), so hits and
+// misses match a detailed run with no victim cache. AAT assumes every L1 miss
+// goes to DRAM, as a detailed run with -v 0 -D reports it.
+class AllAssocSimulator {
+public:
+    // Returns nonzero if the ranges do not describe any valid cache
+    int setup(uint64_t b, uint64_t c_min, uint64_t c_max, uint64_t s_max);
+    void access(uint64_t addr);
+    void finish(std::vector<all_assoc_result_t> *results);
+
+private:
+    // Caches sharing one index width
+    struct IndexGroup {
+        uint64_t index_bits;
+        uint64_t s_min;
+        // LRU stack of each set, as deep as the widest cache in the group
+        CacheLevel stack;
+        // Per associativity 2^(s_min + i): live ways per set and counters
+        std::vector<std::vector<uint32_t> > live;
+        std::vector<uint64_t> hits;
+    };
+
+    uint64_t b;
+    uint64_t c_min;
+    uint64_t c_max;
+    uint64_t s_max;
+    uint64_t accesses;
+    std::vector<IndexGroup> groups;
+};
+
+#endif /* ALL_ASSOC_HPP */
@@ -0,0 +1,307 @@
+#include <stdio.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <chrono>
+#include <vector>
+#include "cachesim.hpp"
+#include "simulator.hpp"
+
+// Throughput benchmark: synthetic workloads generated in process, simulated
+// under a fixed set of geometries and policies. The l1-4w-* configurations
+// differ only in the L2 policy, and l2-64w-* compare policies on wide sets.
+// Each run forks so its peak RSS is its own. Results go to stdout as a table
+// and to a CSV file, one row per run, so two builds can be compared.
+
+typedef struct bench_config {
+    const char *name;
+    uint64_t c1, b, s1, v, c2, s2;
+    replacement_policy_t policy;
+    bool l2_disabled;
+    bool enable_ER;
+} bench_config_t;
+
+static const bench_config_t BENCH_CONFIGS[] = {
+    {"default",      10, 6, 1, 2, 15, 3, REPLACEMENT_POLICY_LIP,    false, false},
+    {"l1-4w-mip",    15, 6, 2, 2, 18, 4, REPLACEMENT_POLICY_MIP,    false, false},
+    {"l1-4w-lip",    15, 6, 2, 2, 18, 4, REPLACEMENT_POLICY_LIP,    false, false},
+    {"l1-4w-fifo",   15, 6, 2, 2, 18, 4, REPLACEMENT_POLICY_FIFO,   false, false},
+    {"l1-4w-random", 15, 6, 2, 2, 18, 4, REPLACEMENT_POLICY_RANDOM, false, false},
+    {"l1-4w-plru",   15, 6, 2, 2, 18, 4, REPLACEMENT_POLICY_TREE_PLRU, false, false},
+    {"l1-4w-srrip",  15, 6, 2, 2, 18, 4, REPLACEMENT_POLICY_SRRIP,  false, false},
+    {"l1-4w-brrip",  15, 6, 2, 2, 18, 4, REPLACEMENT_POLICY_BRRIP,  false, false},
+    {"l1-4w-drrip",  15, 6, 2, 2, 18, 4, REPLACEMENT_POLICY_DRRIP,  false, false},
+    {"l2-64w-lip",   15, 6, 2, 2, 20, 6, REPLACEMENT_POLICY_LIP,    false, false},
+    {"l2-64w-plru",  15, 6, 2, 2, 20, 6, REPLACEMENT_POLICY_TREE_PLRU, false, false},
+    {"l2-64w-drrip", 15, 6, 2, 2, 20, 6, REPLACEMENT_POLICY_DRRIP,  false, false},
+    {"l1-8w-er",     15, 6, 3, 0, 20, 4, REPLACEMENT_POLICY_LIP,    false, true},
+    {"l1-16w-l2-256w", 15, 6, 4, 2, 20, 8, REPLACEMENT_POLICY_LIP,  false, false},
+    {"l1-dm-no-l2",  14, 6, 0, 0, 15, 3, REPLACEMENT_POLICY_LIP,    true,  false},
+};
+
+// xorshift64*, so every build sees the same workloads
+static uint64_t bench_rand(uint64_t *state) {
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 2685821657736338717ULL;
+}
+
+static void push(std::vector<access_t> *out, char rw, uint64_t addr) {
+    access_t a;
+    a.rw = rw;
+    a.addr = addr;
+    out->push_back(a);
+}
+
+// 8-byte words through a 64 MiB array, one store in four
+static void gen_sequential(std::vector<access_t> *out, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        push(out, i % 4 == 3 ? WRITE : READ, 0x10000000 + (i * 8) % (64 << 20));
+    }
+}
+
+// A 1088-byte stride, 17 blocks, through a 64 MiB array
+static void gen_strided(std::vector<access_t> *out, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        push(out, i % 8 == 7 ? WRITE : READ, 0x10000000 + (i * 1088) % (64 << 20));
+    }
+}
+
+// Uniform over 256 MiB, 30% stores
+static void gen_random(std::vector<access_t> *out, size_t n) {
+    uint64_t state = 0x9e3779b97f4a7c15ULL;
+    for (size_t i = 0; i < n; i++) {
+        uint64_t r = bench_rand(&state);
+        push(out, r % 10 < 3 ? WRITE : READ, 0x20000000 + ((r >> 8) % (256 << 20) & ~7ULL));
+    }
+}
+
+// Walks one random cycle through 64K 64-byte nodes, loading the next pointer
+// and updating a field of every sixteenth node
+static void gen_pointer_chase(std::vector<access_t> *out, size_t n) {
+    const size_t nodes = 1 << 16;
+    std::vector<uint32_t> order(nodes);
+    for (size_t i = 0; i < nodes; i++) order[i] = i;
+    uint64_t state = 0x2545f4914f6cdd1dULL;
+    for (size_t i = nodes - 1; i > 0; i--) {
+        std::swap(order[i], order[bench_rand(&state) % (i + 1)]);
+    }
+    std::vector<uint32_t> next(nodes);
+    for (size_t i = 0; i < nodes; i++) next[order[i]] = order[(i + 1) % nodes];
+
+    uint32_t node = order[0];
+    for (size_t i = 0; out->size() < n; i++) {
+        uint64_t addr = 0x40000000 + (uint64_t)node * 64;
+        push(out, READ, addr);
+        if (i % 16 == 15) push(out, WRITE, addr + 8);
+        node = next[node];
+    }
+}
+
+// C += A * B on 256x256 doubles in 32x32 tiles, repeated as needed, the
+// kind of kernel short_matmul_tiled was traced from
+static void gen_matmul_tiled(std::vector<access_t> *out, size_t n) {
+    const uint64_t N = 256, T = 32;
+    const uint64_t A = 0x50000000, B = 0x51000000, C = 0x52000000;
+    while (out->size() < n) {
+        for (uint64_t ii = 0; ii < N; ii += T)
+        for (uint64_t jj = 0; jj < N; jj += T)
+        for (uint64_t kk = 0; kk < N; kk += T)
+        for (uint64_t i = ii; i < ii + T; i++)
+        for (uint64_t j = jj; j < jj + T; j++) {
+            push(out, READ, C + (i * N + j) * 8);
+            for (uint64_t k = kk; k < kk + T; k++) {
+                push(out, READ, A + (i * N + k) * 8);
+                push(out, READ, B + (k * N + j) * 8);
+            }
+            push(out, WRITE, C + (i * N + j) * 8);
+            if (out->size() >= n) {
+                return;
+            }
+        }
+    }
+}
+
+// Generators may overshoot n by this many records; the excess is dropped
+static const size_t BENCH_SLACK = 1024;
+
+typedef struct bench_workload {
+    const char *name;
+    void (*generate)(std::vector<access_t> *out, size_t n);
+} bench_workload_t;
+
+static const bench_workload_t BENCH_WORKLOADS[] = {
+    {"sequential",    gen_sequential},
+    {"strided",       gen_strided},
+    {"random",        gen_random},
+    {"pointer-chase", gen_pointer_chase},
+    {"matmul-tiled",  gen_matmul_tiled},
+};
+
+// What a child reports back through its pipe
+typedef struct bench_result {
+    double seconds;
+    uint64_t hits_l1;
+    uint64_t read_hits_l2;
+} bench_result_t;
+
+static sim_config_t make_config(const bench_config_t *bc) {
+    sim_config_t config = DEFAULT_SIM_CONFIG;
+    config.l1_config.c = bc->c1;
+    config.l1_config.b = bc->b;
+    config.l1_config.s = bc->s1;
+    config.victim_cache_entries = bc->v;
+    config.l2_config.c = bc->c2;
+    config.l2_config.b = bc->b;
+    config.l2_config.s = bc->s2;
+    config.l2_config.replace_policy = bc->policy;
+    config.l2_config.disabled = bc->l2_disabled;
+    config.l2_config.enable_ER = bc->enable_ER;
+    return config;
+}
+
+// Runs in the child: generate, simulate, report
+static void bench_child(const bench_workload_t *workload, const bench_config_t *bc, size_t n, int fd) {
+    std::vector<access_t> trace;
+    trace.reserve(n + BENCH_SLACK);
+    workload->generate(&trace, n);
+    trace.resize(n);
+
+    Simulator sim;
+    sim.setup(make_config(bc));
+    sim.evict_srand(0);
+    sim_stats_t stats;
+    memset(&stats, 0, sizeof stats);
+    auto start = std::chrono::steady_clock::now();
+    sim.access_batch(trace.data(), trace.size(), &stats);
+    sim.finish(&stats);
+    auto stop = std::chrono::steady_clock::now();
+
+    bench_result_t result;
+    result.seconds = std::chrono::duration<double>(stop - start).count();
+    result.hits_l1 = stats.hits_l1;
+    result.read_hits_l2 = stats.read_hits_l2;
+    if (write(fd, &result, sizeof result) != sizeof result) {
+        _exit(1);
+    }
+    _exit(0);
+}
+
+// Returns nonzero if the child failed
+static int bench_run(const bench_workload_t *workload, const bench_config_t *bc, size_t n,
+                     bench_result_t *result, long *peak_rss_kb) {
+    int fds[2];
+    if (pipe(fds)) {
+        return 1;
+    }
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) {
+        return 1;
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        bench_child(workload, bc, n, fds[1]);
+    }
+    close(fds[1]);
+    ssize_t got = read(fds[0], result, sizeof *result);
+    close(fds[0]);
+    int status;
+    struct rusage usage;
+    if (wait4(pid, &status, 0, &usage) != pid || !WIFEXITED(status) || WEXITSTATUS(status)
+        || got != sizeof *result) {
+        return 1;
+    }
+    *peak_rss_kb = usage.ru_maxrss;
+    return 0;
+}
+
+static void print_help(void) {
+    printf("cachesim-bench [OPTIONS]\n");
+    printf("Measures simulator throughput on synthetic workloads (sequential, strided,\n");
+    printf("random, pointer-chase, matmul-tiled) under several geometries and policies.\n");
+    printf("-n N\t\tAccesses per workload (default 2000000)\n");
+    printf("-w NAME\t\tOnly run this workload\n");
+    printf("-o FILE\t\tWrite results as CSV to FILE (default bench_results.csv)\n");
+    printf("-h\t\tThis helpful output\n");
+}
+
+int main(int argc, char **argv) {
+    size_t n = 2000000;
+    const char *only = NULL;
+    const char *out_path = "bench_results.csv";
+    int opt;
+
+    while(-1 != (opt = getopt(argc, argv, "n:w:o:h"))) {
+        switch(opt) {
+        case 'n':
+            n = strtoull(optarg, NULL, 0);
+            break;
+        case 'w':
+            only = optarg;
+            break;
+        case 'o':
+            out_path = optarg;
+            break;
+        case 'h':
+            /* Fall through */
+        default:
+            print_help();
+            return 0;
+        }
+    }
+    if (!n) {
+        printf("Need at least one access per workload\n");
+        return 1;
+    }
+
+    if (only) {
+        bool known = false;
+        for (const bench_workload_t &workload : BENCH_WORKLOADS) {
+            known |= !strcmp(only, workload.name);
+        }
+        if (!known) {
+            printf("Unknown workload `%s'\n", only);
+            return 1;
+        }
+    }
+
+    FILE *out = fopen(out_path, "w");
+    if (!out) {
+        printf("Could not create `%s'\n", out_path);
+        return 1;
+    }
+    fprintf(out, "workload,config,accesses,seconds,accesses_per_sec,ns_per_access,peak_rss_kb,hits_l1,read_hits_l2\n");
+    printf("%-14s %-16s %14s %10s %12s\n", "workload", "config", "accesses/s", "ns/access", "peak RSS KB");
+
+    int failed = 0;
+    for (const bench_workload_t &workload : BENCH_WORKLOADS) {
+        if (only && strcmp(only, workload.name)) {
+            continue;
+        }
+        for (const bench_config_t &bc : BENCH_CONFIGS) {
+            bench_result_t result;
+            long peak_rss_kb;
+            if (bench_run(&workload, &bc, n, &result, &peak_rss_kb)) {
+                printf("%-14s %-16s failed\n", workload.name, bc.name);
+                failed = 1;
+                continue;
+            }
+            double rate = n / result.seconds;
+            double ns = 1e9 * result.seconds / n;
+            printf("%-14s %-16s %14.0f %10.2f %12ld\n", workload.name, bc.name, rate, ns, peak_rss_kb);
+            fprintf(out, "%s,%s,%zu,%.6f,%.0f,%.3f,%ld,%" PRIu64 ",%" PRIu64 "\n", workload.name, bc.name,
+                    n, result.seconds, rate, ns, peak_rss_kb, result.hits_l1, result.read_hits_l2);
+        }
+    }
+    if (fclose(out)) {
+        printf("Could not write `%s'\n", out_path);
+        return 1;
+    }
+    printf("\nResults written to %s\n", out_path);
+    return failed;
+}
@@ -1,9 +1,10 @@
 #include "cachesim.hpp"
-#include <vector>
+#include "simulator.hpp"
 #include <cstdio>
 #include <cstdlib>
-#include <algorithm>
 #include <cinttypes>
+#include <cmath>
+#include <cstring>
 
 /*-------------DO NOT CHANGE THIS BLOCK OF CODE-------------*/
 //Pseudo-Random Number Generator for RANDOM Replacement policy
@@ -20,493 +21,885 @@ void evict_srand(unsigned int seed)
 }
 /*----------------------------------------------------------*/
 
-struct CacheBlock{
-    uint64_t tag;
-    bool valid;
-    bool dirty;
-    bool operator==(const CacheBlock& other) const {
-        return tag == other.tag && valid == other.valid && dirty == other.dirty;
-    }
-};
-
-struct VictimBlock {
-    uint64_t tag;
-    uint64_t index;
-    bool valid;
-    bool dirty;
-    bool operator==(const VictimBlock& other) const {
-        return tag == other.tag && index == other.index && valid == other.valid && dirty == other.dirty;
-    }    
-};
+Simulator::Simulator(unsigned long *rng_state)
+    : early_restart_offset_sum(0), early_restart_offset_count(0),
+      drrip_psel(DRRIP_PSEL_INIT), brrip_insertions(0),
+      own_rng_state(1), rng_state(rng_state ? rng_state : &own_rng_state), l2_stream(NULL),
+      l2_stream_lost(false) {
+    m_config = DEFAULT_SIM_CONFIG;
+    memset(&m_profile, 0, sizeof m_profile);
+}
 
-typedef std::vector<CacheBlock> CacheSet;
-std::vector<CacheSet> L1_cache;
-std::vector<VictimBlock> victim_cache;
-std::vector<CacheSet> L2_cache;
-sim_config_t m_config;
+int Simulator::evict_random() {
+    *rng_state = *rng_state * 1103515243 + 12345;
+    return (unsigned int)(*rng_state / 65536) % 32768;
+}
 
-uint64_t early_restart_offset_sum = 0;
-uint64_t early_restart_offset_count = 0;
+void Simulator::evict_srand(unsigned int seed) {
+    *rng_state = seed;
+}
 
 /**
  * Subroutine for initializing the cache simulator. You many add and initialize any global or heap
  * variables as needed.
- * TODO: You're responsible for completing this routine
  */
 
-void sim_setup(sim_config_t *config) {
-    m_config = *config;
+void Simulator::setup(const sim_config_t &config) {
+    m_config = config;
+    memset(&m_profile, 0, sizeof m_profile);
+    early_restart_offset_sum = 0;
+    early_restart_offset_count = 0;
+    drrip_psel = DRRIP_PSEL_INIT;
+    brrip_insertions = 0;
+    next_use.clear();
+
+    l1_block_offset_bits = m_config.l1_config.b;
+    l1_index_bits = m_config.l1_config.c - m_config.l1_config.b - m_config.l1_config.s;
+    l1_index_mask = ((uint64_t)1 << l1_index_bits) - 1;
+    l2_block_offset_bits = m_config.l2_config.b;
+    l2_index_bits = m_config.l2_config.c - m_config.l2_config.b - m_config.l2_config.s;
+    l2_index_mask = ((uint64_t)1 << l2_index_bits) - 1;
+    l2_offset_mask = ((uint64_t)1 << l2_block_offset_bits) - 1;
+
+    l1_writes_through = m_config.l1_config.write_strat == WRITE_STRAT_WTWNA;
+    l2_writes_back = !m_config.l2_config.disabled && m_config.l2_config.write_strat == WRITE_STRAT_WBWA;
+    hit_time_l1 = L1_HIT_TIME_CONST + (m_config.l1_config.s * L1_HIT_TIME_PER_S);
+    hit_time_l2 = L2_HIT_TIME_CONST + (m_config.l2_config.s * L2_HIT_TIME_PER_S);
+    dram_time = DRAM_AT + (DRAM_AT_PER_WORD * ((uint64_t)1 << m_config.l2_config.b) / WORD_SIZE);
+    write_buffer.init(m_config.write_buffer.entries,
+                      m_config.write_buffer.drain_cycles > 0 ? m_config.write_buffer.drain_cycles : dram_time,
+                      m_config.write_buffer.merge);
+    l1_prefetcher.init(m_config.prefetch_l1, l1_block_offset_bits);
+    l2_prefetcher.init(m_config.l2_config.disabled ? DEFAULT_SIM_CONFIG.prefetch_l2 : m_config.prefetch_l2,
+                       l2_block_offset_bits);
+    l1_prefetches.init();
+    l2_prefetches.init();
+    l1_prefetch_read = false;
+
     // L1 Cache: (l1_config->c, l1_config->b, l1_config->s)
-    uint64_t l1CacheTagBit = m_config.l1_config.c - m_config.l1_config.b - m_config.l1_config.s;
-    uint64_t l1CacheNumSets = 1 << l1CacheTagBit;
-    L1_cache.resize(l1CacheNumSets);
-    for (uint64_t i = 0; i < l1CacheNumSets; i++) {
-        L1_cache[i].resize(1 << m_config.l1_config.s, {0, false, false});
-    }
+    L1_cache.init(l1_index_bits, m_config.l1_config.s);
     // Victim Cache: config->victim_cache_entries
-    if (config->victim_cache_entries > 0) {
-        victim_cache.resize(config->victim_cache_entries, {0, 0, false, false});
+    if (m_config.victim_cache_entries > 0) {
+        victim_cache.init(m_config.victim_cache_entries);
     }
-    if (!m_config.l2_config.disabled) {
-        uint64_t l2CacheTagBit = m_config.l2_config.c - m_config.l2_config.b - m_config.l2_config.s;
-        uint64_t l2CacheNumSets = 1 << l2CacheTagBit;
-        L2_cache.resize(l2CacheNumSets);
-        for (uint64_t i = 0; i < l2CacheNumSets; i++) {
-            L2_cache[i].resize(1 << m_config.l2_config.s, {0, false, false});
-        }    
+    // Only one of the L2 layouts holds storage at a time
+    L2_cache = CacheLevel();
+    sparse_L2_cache = SparseCacheLevel();
+
+    if (m_config.l2_config.disabled) {
+        // The policy is never consulted without an L2
+        select_kernels<REPLACEMENT_POLICY_MIP, L2_NONE>();
+    }
+    else if (m_config.l2_config.sparse) {
+        sparse_L2_cache.init(64 - l2_block_offset_bits - l2_index_bits, m_config.l2_config.s,
+                             policy_state_words(m_config.l2_config.replace_policy, (uint64_t)1 << m_config.l2_config.s));
+        select_policy<L2_SPARSE>();
+    }
+    else {
+        L2_cache.init(l2_index_bits, m_config.l2_config.s);
+        L2_cache.init_policy(policy_state_words(m_config.l2_config.replace_policy, L2_cache.ways));
+        select_policy<L2_FLAT>();
+    }
+}
+
+template <l2_storage_t L2>
+void Simulator::select_policy() {
+    switch (m_config.l2_config.replace_policy)
+    {
+        case REPLACEMENT_POLICY_MIP:
+            select_kernels<REPLACEMENT_POLICY_MIP, L2>();
+            break;
+        case REPLACEMENT_POLICY_LIP:
+            select_kernels<REPLACEMENT_POLICY_LIP, L2>();
+            break;
+        case REPLACEMENT_POLICY_FIFO:
+            select_kernels<REPLACEMENT_POLICY_FIFO, L2>();
+            break;
+        case REPLACEMENT_POLICY_TREE_PLRU:
+            select_kernels<REPLACEMENT_POLICY_TREE_PLRU, L2>();
+            break;
+        case REPLACEMENT_POLICY_SRRIP:
+            select_kernels<REPLACEMENT_POLICY_SRRIP, L2>();
+            break;
+        case REPLACEMENT_POLICY_BRRIP:
+            select_kernels<REPLACEMENT_POLICY_BRRIP, L2>();
+            break;
+        case REPLACEMENT_POLICY_DRRIP:
+            select_kernels<REPLACEMENT_POLICY_DRRIP, L2>();
+            break;
+        case REPLACEMENT_POLICY_OPT:
+            select_kernels<REPLACEMENT_POLICY_OPT, L2>();
+            break;
+        case REPLACEMENT_POLICY_RANDOM:
+        default:
+            select_kernels<REPLACEMENT_POLICY_RANDOM, L2>();
+            break;
+    }
+}
+
+template <replacement_policy_t POLICY, l2_storage_t L2>
+void Simulator::select_kernels() {
+    if (m_config.victim_cache_entries > 0) {
+        select_l1_ways<POLICY, true, L2>();
+    }
+    else {
+        select_l1_ways<POLICY, false, L2>();
+    }
+    l2_read_fn = &Simulator::l2_read<POLICY, L2>;
+    l2_write_back_fn = &Simulator::l2_write_back<POLICY, L2>;
+}
+
+template <replacement_policy_t POLICY, bool VICTIM, l2_storage_t L2>
+void Simulator::select_l1_ways() {
+    switch (L1_cache.ways)
+    {
+        case 1:
+            use_kernels<POLICY, VICTIM, L2, 1>();
+            break;
+        case 2:
+            use_kernels<POLICY, VICTIM, L2, 2>();
+            break;
+        case 4:
+            use_kernels<POLICY, VICTIM, L2, 4>();
+            break;
+        case 8:
+            use_kernels<POLICY, VICTIM, L2, 8>();
+            break;
+        default:
+            use_kernels<POLICY, VICTIM, L2, 0>();
+            break;
+    }
+}
+
+template <replacement_policy_t POLICY, bool VICTIM, l2_storage_t L2, int L1_WAYS>
+void Simulator::use_kernels() {
+    access_fn = &Simulator::access_kernel<POLICY, VICTIM, L2, L1_WAYS>;
+    access_batch_fn = &Simulator::access_batch_kernel<POLICY, VICTIM, L2, L1_WAYS>;
+}
+
+// Moves an L1 hit to MRU. The original vector engine did this with
+// erase(remove(set, *found)), handing remove() a reference into the range it
+// was compacting: once the hit block had been overwritten, every later copy of
+// the block that replaced it was dropped too. Empty ways are all equal, so a
+// hit on the last valid block of a set with two or more empty ways left it
+// with a single empty way and the set shrank for good. Statistics depend on
+// it, so the extra ways are retired here the same way.
+template <int WAYS>
+void Simulator::l1_promote(uint64_t set, int way) {
+    if (WAYS == 1) {
+        // A single way is always at the front, and there is nothing to retire
+        return;
+    }
+    uint32_t used = L1_cache.used[set];
+    if (L1_cache.ranks[L1_cache.base<WAYS>(set) + way] == used - 1 && L1_cache.live[set] - used >= 2) {
+        L1_cache.live[set] = used + 1;
+    }
+    L1_cache.to_front<WAYS>(set, way);
+}
+
+// A write reaching L2: an L1 or victim cache write-back, or an L1
+// write-through. A write-through L2 refreshes the recency of the matching
+// block under MIP/LIP, counts it as a hit for tree-PLRU and RRIP, and passes
+// the data on to DRAM. A write-back L2 treats it like a read that dirties
+// the block, allocating on a miss.
+template <replacement_policy_t POLICY, l2_storage_t L2>
+void Simulator::l2_write_back(uint64_t block_addr, sim_stats_t *stats) {
+    if (L2 == L2_NONE) {
+        dram_write(block_addr, stats);
+    }
+    else if (L2 == L2_SPARSE) {
+        l2_write_back_level<POLICY>(sparse_L2_cache, block_addr, stats);
+    }
+    else {
+        l2_write_back_level<POLICY>(L2_cache, block_addr, stats);
+    }
+}
+
+template <replacement_policy_t POLICY, typename LEVEL>
+void Simulator::l2_write_back_level(LEVEL &cache, uint64_t block_addr, sim_stats_t *stats) {
+    uint64_t l2_tag = block_addr >> l2_index_bits;
+    uint64_t l2_index = block_addr & l2_index_mask;
+    uint64_t l2_set = cache.touch_set(l2_index);
+    if (l2_writes_back) {
+        int found = cache.lookup(l2_set, l2_tag);
+        if (found != -1) {
+            stats->write_hits_l2++;
+            cache.set_dirty(l2_set, found);
+            l2_touch<POLICY>(cache, l2_set, found, OPT_NEVER);
+            return;
+        }
+        stats->write_misses_l2++;
+        l2_fill<POLICY>(cache, l2_set, l2_index, l2_tag, true, OPT_NEVER, stats);
+        return;
+    }
+
+    dram_write(block_addr, stats);
+    if (POLICY == REPLACEMENT_POLICY_FIFO || POLICY == REPLACEMENT_POLICY_RANDOM
+        || POLICY == REPLACEMENT_POLICY_OPT) {
+        // FIFO, RANDOM and OPT ignore write-backs
+        if (cache.lookup(l2_set, l2_tag) != -1) stats->write_hits_l2++;
+        else stats->write_misses_l2++;
+        return;
+    }
+    if (POLICY == REPLACEMENT_POLICY_TREE_PLRU || policy_is_rrip(POLICY)) {
+        // No first_match() quirk to keep for the newer policies
+        int found = cache.lookup(l2_set, l2_tag);
+        if (found == -1) {
+            stats->write_misses_l2++;
+            return;
+        }
+        stats->write_hits_l2++;
+        if (POLICY == REPLACEMENT_POLICY_TREE_PLRU) plru_touch(cache.policy_state(l2_set), cache.ways, found);
+        else rrpv_set(cache.policy_state(l2_set), found, 0);
+        return;
+    }
+    int found = cache.first_match(l2_set, l2_tag);
+    if (found == -1) {
+        stats->write_misses_l2++;
+        return;
+    }
+    // first_match() may have picked an empty way, which is no hit
+    if ((uint32_t)found < cache.used[l2_set]) stats->write_hits_l2++;
+    else stats->write_misses_l2++;
+    cache.to_front(l2_set, found);
+}
+
+// Time so far, in the cycles the AAT is measured in: a hit time per access
+// at each level it reached, a DRAM time per L2 read miss, and the write
+// buffer stalls
+double Simulator::cycles(const sim_stats_t *stats) const {
+    double l2_time = m_config.l2_config.disabled ? 0 : stats->reads_l2 * hit_time_l2;
+    return stats->accesses_l1 * hit_time_l1 + l2_time + stats->read_misses_l2 * dram_time
+        + stats->write_buffer_stall_cycles;
+}
+
+// A block written to DRAM by the last cache level, through the write buffer
+// when there is one
+void Simulator::dram_write(uint64_t block_addr, sim_stats_t *stats) {
+    if (write_buffer.blocks.empty()) {
+        stats->writes_dram++;
+        return;
+    }
+    double stall = write_buffer.write(block_addr, cycles(stats));
+    if (stall < 0) {
+        stats->write_buffer_merges++;
+        return;
+    }
+    stats->writes_dram++;
+    if (stall > 0) {
+        stats->write_buffer_stalls++;
+        stats->write_buffer_stall_cycles += stall;
+    }
+}
+
+// RRPV for a block filled into the set at index, counting the miss against
+// DRRIP's leader sets
+template <replacement_policy_t POLICY>
+unsigned Simulator::rrip_insertion(uint64_t index) {
+    bool bimodal = POLICY == REPLACEMENT_POLICY_BRRIP;
+    if (POLICY == REPLACEMENT_POLICY_DRRIP) {
+        int leader = drrip_leader(index);
+        if (leader == 1) {
+            if (drrip_psel < DRRIP_PSEL_MAX) drrip_psel++;
+            bimodal = false;
+        }
+        else if (leader == 2) {
+            if (drrip_psel > 0) drrip_psel--;
+            bimodal = true;
+        }
+        else {
+            bimodal = drrip_psel >= DRRIP_PSEL_INIT;
+        }
+    }
+    if (!bimodal) {
+        return RRPV_LONG;
+    }
+    return ++brrip_insertions % BRRIP_THROTTLE == 0 ? RRPV_LONG : RRPV_DISTANT;
+}
+
+// The L2 side of an access that missed in L1 and the victim cache
+template <replacement_policy_t POLICY, l2_storage_t L2>
+void Simulator::l2_read(uint64_t addr, sim_stats_t *stats) {
+    if (L2 == L2_NONE) {
+        stats->read_misses_l2++;
+    }
+    else if (L2 == L2_SPARSE) {
+        l2_read_level<POLICY>(sparse_L2_cache, addr, stats);
+    }
+    else {
+        l2_read_level<POLICY>(L2_cache, addr, stats);
     }
 }
 
+template <replacement_policy_t POLICY, typename LEVEL>
+void Simulator::l2_read_level(LEVEL &cache, uint64_t addr, sim_stats_t *stats) {
+    // Try finding in L2 Cache!
+    uint64_t l2_tag = addr >> (l2_block_offset_bits + l2_index_bits);
+    uint64_t l2_index = (addr >> l2_block_offset_bits) & l2_index_mask;
+    uint64_t l2_set = cache.touch_set(l2_index);
+    uint64_t next_use_at = POLICY == REPLACEMENT_POLICY_OPT ? next_use.next() : 0;
+
+    int l2_way = cache.lookup(l2_set, l2_tag);
+    if (l2_way != -1) {
+        #ifdef DEBUG
+        printf("%" PRIu64 ": L2 read hit\n", stats->accesses_l1-1);
+        #endif
+        stats->read_hits_l2++;
+        l2_touch<POLICY>(cache, l2_set, l2_way, next_use_at);
+        if (l2_prefetcher.enabled() && cache.prefetched(l2_set, l2_way)) {
+            cache.clear_prefetched(l2_set, l2_way);
+            prefetch_used(l2_prefetches, addr >> l2_block_offset_bits, &stats->useful_prefetches_l2,
+                          &stats->late_prefetches_l2, stats);
+        }
+        profile_lap(PROFILE_L2_LOOKUP);
+        return;
+    }
+    profile_lap(PROFILE_L2_LOOKUP);
+
+    #ifdef DEBUG
+    printf("%" PRIu64 ": L2 read miss\n", stats->accesses_l1-1);
+    #endif
+    stats->read_misses_l2++;
+
+    // Accumulated whether or not early restart is on; finish() only reads
+    // it when it is. Prefetches wait for the whole block.
+    if (!l1_prefetch_read) {
+        early_restart_offset_sum += (addr & l2_offset_mask) / WORD_SIZE;
+        early_restart_offset_count++;
+    }
+
+    uint64_t block_addr = addr >> l2_block_offset_bits;
+    if (l2_prefetcher.enabled() && !l1_prefetch_read && l2_prefetches.take_evicted(block_addr)) {
+        stats->polluting_prefetches_l2++;
+    }
+    l2_fill<POLICY>(cache, l2_set, l2_index, l2_tag, false, next_use_at, stats);
+    profile_lap(PROFILE_L2_FILL);
+
+    if (l2_prefetcher.enabled() && !l1_prefetch_read) {
+        l2_prefetch<POLICY>(cache, block_addr, stats);
+    }
+}
+
+// Fills the blocks the L2 prefetcher asks for after a demand miss on
+// block_addr straight from DRAM
+template <replacement_policy_t POLICY, typename LEVEL>
+void Simulator::l2_prefetch(LEVEL &cache, uint64_t block_addr, sim_stats_t *stats) {
+    uint64_t blocks[PREFETCH_MAX_DEGREE];
+    unsigned n = l2_prefetcher.train(block_addr, blocks);
+    for (unsigned i = 0; i < n; i++) {
+        if (blocks[i] >> (64 - l2_block_offset_bits)) {
+            // Past either end of the address space
+            continue;
+        }
+        uint64_t index = blocks[i] & l2_index_mask;
+        uint64_t tag = blocks[i] >> l2_index_bits;
+        uint64_t set = cache.touch_set(index);
+        if (cache.lookup(set, tag) != -1) {
+            continue;
+        }
+        stats->prefetches_l2++;
+        l2_prefetches.ready_at[blocks[i]] = cycles(stats) + dram_time;
+        l2_fill<POLICY>(cache, set, index, tag, false, OPT_NEVER, stats, true);
+    }
+}
+
+// A demand access found a block a prefetch brought in
+void Simulator::prefetch_used(PrefetchTracker &tracker, uint64_t block_addr, uint64_t *useful, uint64_t *late,
+                              sim_stats_t *stats) {
+    (*useful)++;
+    auto found = tracker.ready_at.find(block_addr);
+    if (found != tracker.ready_at.end()) {
+        if (cycles(stats) < found->second) (*late)++;
+        tracker.ready_at.erase(found);
+    }
+}
+
+// A block leaving a level that prefetches
+void Simulator::prefetch_evicted(PrefetchTracker &tracker, uint64_t block_addr, bool was_prefetched,
+                                 bool by_prefetch, uint64_t *unused) {
+    if (was_prefetched) {
+        (*unused)++;
+        tracker.ready_at.erase(block_addr);
+    }
+    if (by_prefetch) {
+        tracker.mark_evicted(block_addr);
+    }
+}
+
+// Recency update for a hit
+template <replacement_policy_t POLICY, typename LEVEL>
+void Simulator::l2_touch(LEVEL &cache, uint64_t set, int way, uint64_t next_use_at) {
+    if (POLICY == REPLACEMENT_POLICY_MIP || POLICY == REPLACEMENT_POLICY_LIP) {
+        cache.to_front(set, way);
+    }
+    else if (POLICY == REPLACEMENT_POLICY_TREE_PLRU) {
+        plru_touch(cache.policy_state(set), cache.ways, way);
+    }
+    else if (policy_is_rrip(POLICY)) {
+        rrpv_set(cache.policy_state(set), way, 0);
+    }
+    else if (POLICY == REPLACEMENT_POLICY_OPT) {
+        cache.policy_state(set)[way] = next_use_at;
+    }
+}
+
+// Brings a missing block into its set, evicting one if the set is full
+template <replacement_policy_t POLICY, typename LEVEL>
+void Simulator::l2_fill(LEVEL &cache, uint64_t l2_set, uint64_t l2_index, uint64_t l2_tag, bool dirty,
+                        uint64_t next_use_at, sim_stats_t *stats, bool prefetched) {
+    int l2_way = cache.free_way(l2_set);
+    if (l2_way == -1) {
+        if (POLICY == REPLACEMENT_POLICY_TREE_PLRU) {
+            l2_way = plru_victim(cache.policy_state(l2_set), cache.ways);
+        }
+        else if (policy_is_rrip(POLICY)) {
+            l2_way = rrip_victim(cache.policy_state(l2_set), cache.ways);
+        }
+        else if (POLICY == REPLACEMENT_POLICY_OPT) {
+            l2_way = opt_victim(cache.policy_state(l2_set), cache.ways);
+        }
+        else {
+            // Pick the L2 victim block by its position in the set
+            int rank = cache.ways - 1;
+            if (POLICY == REPLACEMENT_POLICY_RANDOM) {
+                if (cache.ways == 1) rank = 0;
+                else rank = evict_random() % (cache.ways - 1);
+            }
+            l2_way = cache.way_at(l2_set, rank);
+        }
+        #ifdef DEBUG
+        printf("Evict from L2: block with tag 0x%" PRIx64 " and index=0x%" PRIx64 "\n", cache.tag(l2_set, l2_way), l2_index);
+        #endif
+        if (l2_writes_back && cache.dirty(l2_set, l2_way)) {
+            stats->write_backs_l2++;
+            dram_write((cache.tag(l2_set, l2_way) << l2_index_bits) | l2_index, stats);
+        }
+        if (l2_prefetcher.enabled()) {
+            prefetch_evicted(l2_prefetches, (cache.tag(l2_set, l2_way) << l2_index_bits) | l2_index,
+                             cache.prefetched(l2_set, l2_way), prefetched, &stats->unused_prefetches_l2);
+        }
+    }
+    if (l2_prefetcher.enabled()) {
+        l2_prefetches.refilled(l2_tag << l2_index_bits | l2_index);
+    }
+    cache.fill(l2_set, l2_way, l2_tag, dirty, prefetched);
+
+    if (POLICY == REPLACEMENT_POLICY_MIP || POLICY == REPLACEMENT_POLICY_FIFO) {
+        cache.to_front(l2_set, l2_way);
+    }
+    else if (POLICY == REPLACEMENT_POLICY_LIP || POLICY == REPLACEMENT_POLICY_RANDOM) {
+        cache.to_back(l2_set, l2_way);
+    }
+    else if (POLICY == REPLACEMENT_POLICY_TREE_PLRU) {
+        plru_touch(cache.policy_state(l2_set), cache.ways, l2_way);
+    }
+    else if (POLICY == REPLACEMENT_POLICY_OPT) {
+        cache.policy_state(l2_set)[l2_way] = next_use_at;
+    }
+    else {
+        rrpv_set(cache.policy_state(l2_set), l2_way, rrip_insertion<POLICY>(l2_index));
+    }
+}
+
+// A dirty block leaving L1 or the victim cache
+template <replacement_policy_t POLICY, l2_storage_t L2>
+void Simulator::l1_write_back(uint64_t block_addr, sim_stats_t *stats) {
+    // Called from the middle of an L1 fill
+    profile_split(PROFILE_L1_FILL);
+    stats->write_backs_l1_or_victim_cache++;
+    stats->writes_l2++;
+    if (l2_stream) {
+        record_l2(WRITE, block_addr << l1_block_offset_bits);
+    }
+    l2_write_back<POLICY, L2>(block_addr, stats);
+    profile_lap(PROFILE_WRITE_BACK);
+}
+
+// A write that a write-through L1 passes down, hit or miss
+template <replacement_policy_t POLICY, l2_storage_t L2>
+void Simulator::l1_write_through(uint64_t block_addr, sim_stats_t *stats) {
+    stats->writes_l2++;
+    if (l2_stream) {
+        record_l2(WRITE, block_addr << l1_block_offset_bits);
+    }
+    l2_write_back<POLICY, L2>(block_addr, stats);
+    profile_lap(PROFILE_WRITE_BACK);
+}
+
 /**
  * Subroutine that simulates the cache one trace event at a time.
- * TODO: You're responsible for completing this routine
  */
-void sim_access(char rw, uint64_t addr, sim_stats_t* stats) {
+void Simulator::access(char rw, uint64_t addr, sim_stats_t* stats) {
+    (this->*access_fn)(rw, addr, stats);
+}
+
+void Simulator::access_batch(const access_t *accesses, size_t count, sim_stats_t *stats) {
+    (this->*access_batch_fn)(accesses, count, stats);
+}
+
+void Simulator::warm_batch(const access_t *accesses, size_t count) {
+    sim_stats_t scratch;
+    memset(&scratch, 0, sizeof scratch);
+    // Early restart offsets are statistics too
+    uint64_t offset_sum = early_restart_offset_sum;
+    uint64_t offset_count = early_restart_offset_count;
+    (this->*access_batch_fn)(accesses, count, &scratch);
+    early_restart_offset_sum = offset_sum;
+    early_restart_offset_count = offset_count;
+}
+
+// One dispatch per batch, with the kernel inlined into the loop
+template <replacement_policy_t POLICY, bool VICTIM, l2_storage_t L2, int L1_WAYS>
+void Simulator::access_batch_kernel(const access_t *accesses, size_t count, sim_stats_t *stats) {
+    for (size_t i = 0; i < count; i++) {
+        access_kernel<POLICY, VICTIM, L2, L1_WAYS>(accesses[i].rw, accesses[i].addr, stats);
+    }
+}
+
+template <replacement_policy_t POLICY, bool VICTIM, l2_storage_t L2, int L1_WAYS>
+void Simulator::access_kernel(char rw, uint64_t addr, sim_stats_t* stats) {
     if (rw == 'R') stats->reads++;
     else if (rw == 'W') stats->writes++;
 
     stats->accesses_l1++;
+    profile_begin();
 
     // Judge: Found in L1 Cache?
-    uint64_t l1_victim_block_offset_bits = m_config.l1_config.b;
-    uint64_t l1_victim_index_bits = m_config.l1_config.c - m_config.l1_config.b - m_config.l1_config.s;
+    uint64_t l1_block_addr = addr >> l1_block_offset_bits;
+    uint64_t l1_tag = l1_block_addr >> l1_index_bits;
+    uint64_t l1_index = l1_block_addr & l1_index_mask;
 
-    uint64_t l1_victim_tag = addr >> (l1_victim_block_offset_bits + l1_victim_index_bits);
-    uint64_t l1_victim_index = (addr >> l1_victim_block_offset_bits) & ((1 << l1_victim_index_bits) - 1);
-    if (l1_victim_index_bits == 0) l1_victim_index = 0;
-
-    uint64_t l2_block_offset_bits = m_config.l2_config.b;
-    uint64_t l2_index_bits = m_config.l2_config.c - m_config.l2_config.b - m_config.l2_config.s;
-
-    uint64_t l2_tag = addr >> (l2_block_offset_bits + l2_index_bits);
-    uint64_t l2_index = (addr >> l2_block_offset_bits) & ((1 << l2_index_bits) - 1);
-
-    CacheSet &l1_set = L1_cache[l1_victim_index];
-    CacheSet &l2_set = L2_cache[l2_index];
-
-    // if (stats->accesses_l1 - 1>= 6766 && stats->accesses_l1 - 1 <= 40000) {
-    //     printf("L1 decomposed address 0x%lx -> Tag: 0x%lx and Index: 0x%lx\n", addr, l1_victim_tag, l1_victim_index);
-    //     printf("L2 decomposed address 0x%lx -> Tag: 0x%lx and Index: 0x%lx\n", addr, l2_tag, l2_index);
-    //     printf("%d: Tag:  ", stats->accesses_l1 - 1);
-    //     if (!m_config.l2_config.disabled) {
-    //         CacheSet t = L2_cache[49];
-    //         for (int i = 0; i < t.size(); i++) {
-    //             printf("0x%lx ", t[i].tag);
-    //         }
-    //         printf("\n");
-    //     }
-    // }
-
-    CacheBlock* l1_found_block = nullptr;
-    for (CacheBlock &l1_block : l1_set) {
-        if (l1_block.valid && l1_block.tag == l1_victim_tag) {
-            l1_found_block = &l1_block;
-            break;
-        }
-    }
-
-    if (l1_found_block) {
+    int l1_way = L1_cache.lookup<L1_WAYS>(l1_index, l1_tag);
+    if (l1_way != -1) {
         // L1 Cache Hit
         #ifdef DEBUG
-        printf("%d: L1 hit\n", stats->accesses_l1-1);
-        #endif    
+        printf("%" PRIu64 ": L1 hit\n", stats->accesses_l1-1);
+        #endif
         stats->hits_l1++;
-        if (rw == 'W') l1_found_block->dirty = true;
-
-        CacheBlock newFoundBlock = *l1_found_block;
-
+        if (l1_prefetcher.enabled() && L1_cache.prefetched<L1_WAYS>(l1_index, l1_way)) {
+            L1_cache.clear_prefetched(l1_index, l1_way);
+            prefetch_used(l1_prefetches, l1_block_addr, &stats->useful_prefetches_l1,
+                          &stats->late_prefetches_l1, stats);
+        }
         // Move block to MRU position
-        l1_set.erase(std::remove(l1_set.begin(), l1_set.end(), *l1_found_block), l1_set.end());
-        l1_set.insert(l1_set.begin(), newFoundBlock);
+        l1_promote<L1_WAYS>(l1_index, l1_way);
+        profile_lap(PROFILE_L1_PROBE);
+        if (rw == 'W') {
+            if (l1_writes_through) l1_write_through<POLICY, L2>(l1_block_addr, stats);
+            else L1_cache.flags[L1_cache.base<L1_WAYS>(l1_index) + l1_way] |= BLOCK_DIRTY;
+        }
         return;
-    } 
-    else {
-        stats->misses_l1++;
-
-        // Find in Victim Cache
-        VictimBlock* found_victim_block = NULL;
-        bool victimDirty = false;
-        bool victimIsFound = false;
-        if (m_config.victim_cache_entries > 0) {
-            for (VictimBlock &block : victim_cache) {
-                if (block.valid && block.tag == l1_victim_tag && block.index == l1_victim_index) {
-                    found_victim_block = &block;
-                    victimDirty |= block.dirty;
-                    break;
-                }
-            }
+    }
 
-            CacheBlock newBlock;
-            newBlock.dirty = ((rw == 'W') || victimDirty);
-            newBlock.valid = true;
-            newBlock.tag = l1_victim_tag;
+    stats->misses_l1++;
+    profile_lap(PROFILE_L1_PROBE);
 
-            if (found_victim_block) {
-                victimIsFound = true;
+    if (rw == 'W' && l1_writes_through) {
+        // No allocation: a copy in the victim cache is refreshed, and the
+        // write goes on down either way
+        if (VICTIM) {
+            int vc_way = victim_cache.lookup(l1_block_addr);
+            if (vc_way != -1) {
                 stats->hits_victim_cache++;
-                // Transferred to L1 Cache!
-                // Judge: Any element in L1 set invalid?
-                int invalidIndexInL1 = -1;
-                for (int i = 0; i < l1_set.size(); i++) {
-                    if (l1_set[i].valid == false) {
-                        invalidIndexInL1 = i;
-                        break;
-                    }
-                }
-                if (invalidIndexInL1 != -1) {
-                    // Move to MRU
-                    l1_set.erase(l1_set.begin() + invalidIndexInL1);
-                    l1_set.insert(l1_set.begin(), newBlock);
-                    victim_cache.erase(std::remove(victim_cache.begin(), victim_cache.end(), *found_victim_block), victim_cache.end());
-                }
-                else {
-                    // A literal swap: l1[last] and found victim cache
-                    int invalidIndexInL1 = l1_set.size()-1;
-                    VictimBlock nvBlock;
-                    nvBlock.dirty = l1_set[invalidIndexInL1].dirty;
-                    nvBlock.valid = l1_set[invalidIndexInL1].valid;
-                    nvBlock.tag = l1_set[invalidIndexInL1].tag;
-                    nvBlock.index = l1_victim_index;   
-                    victim_cache.erase(std::remove(victim_cache.begin(), victim_cache.end(), *found_victim_block), victim_cache.end());
-                    victim_cache.insert(victim_cache.begin(), nvBlock); 
-                    l1_set.erase(l1_set.begin() + invalidIndexInL1);
-                    l1_set.insert(l1_set.begin(), newBlock);
-                }
-                return;
+                victim_cache.to_front(vc_way);
             }
-
             else {
-                victimIsFound = false;
                 stats->misses_victim_cache++;
+                stats->posted_write_misses_l1++;
             }
+            profile_lap(PROFILE_VICTIM_CACHE);
         }
         else {
             stats->misses_victim_cache++;
+            stats->posted_write_misses_l1++;
         }
+        l1_write_through<POLICY, L2>(l1_block_addr, stats);
+        return;
+    }
 
-        stats->reads_l2++;
-        if (m_config.l2_config.disabled) {
-            stats->read_misses_l2++;
+    // Find in Victim Cache
+    if (VICTIM) {
+        int vc_way = victim_cache.lookup(l1_block_addr);
+        if (vc_way != -1) {
+            stats->hits_victim_cache++;
+            // A literal swap: L1 LRU block and the found victim block. The
+            // victim block's L1 set was full when it was evicted and L1 sets
+            // never drain, so there is always an L1 block to trade.
+            bool dirty = (rw == 'W') || victim_cache.dirty(vc_way);
+            int lru = L1_cache.back_way<L1_WAYS>(l1_index);
+            uint64_t lru_block_addr = (L1_cache.tags[L1_cache.base<L1_WAYS>(l1_index) + lru] << l1_index_bits) | l1_index;
+            if (l1_prefetcher.enabled()) {
+                prefetch_evicted(l1_prefetches, lru_block_addr, L1_cache.prefetched<L1_WAYS>(l1_index, lru), false,
+                                 &stats->unused_prefetches_l1);
+            }
+            victim_cache.fill(vc_way, lru_block_addr, L1_cache.dirty<L1_WAYS>(l1_index, lru));
+            victim_cache.to_front(vc_way);
+            if (l1_prefetcher.enabled()) {
+                l1_prefetches.refilled(l1_block_addr);
+            }
+            L1_cache.fill<L1_WAYS>(l1_index, lru, l1_tag, dirty);
+            L1_cache.to_front<L1_WAYS>(l1_index, lru);
+            profile_lap(PROFILE_VICTIM_CACHE);
+            return;
         }
+        profile_lap(PROFILE_VICTIM_CACHE);
+    }
+    stats->misses_victim_cache++;
 
-        // Try finding in L2 Cache!
-        if (!victimIsFound && !m_config.l2_config.disabled) {
-            // Block in L2 Cache?
-            int foundId = -1;
-            for (int i = 0; i < l2_set.size(); i++) {
-                if (l2_set[i].valid && l2_set[i].tag == l2_tag) {
-                    foundId = i;
-                    break;
-                }
-            }
+    stats->reads_l2++;
+    if (l2_stream) {
+        record_l2(READ, addr);
+    }
+    l2_read<POLICY, L2>(addr, stats);
 
-            if (foundId != -1) {
-                #ifdef DEBUG
-                printf("%d: L2 read hit\n", stats->accesses_l1-1);
-                #endif            
-                stats->read_hits_l2++;
-                switch (m_config.l2_config.replace_policy)
-                {
-                    case REPLACEMENT_POLICY_MIP:
-                    case REPLACEMENT_POLICY_LIP:
-                        std::rotate(l2_set.begin(), l2_set.begin() + foundId, l2_set.begin() + foundId + 1);
-                        #ifdef DEBUG
-                        printf("%d: 2 In L2, moving Tag: 0x%" PRIx64 " and Index: 0x%" PRIx64 " to MRU position\n", stats->accesses_l1-1, l2_set[0].tag, l2_index);
-                        #endif
-                        break;
-                    case REPLACEMENT_POLICY_RANDOM:
-                    case REPLACEMENT_POLICY_FIFO:
-                        break;
-                    default:
-                        break;          
-                }
-            }
+    if (l1_prefetcher.enabled() && l1_prefetches.take_evicted(l1_block_addr)) {
+        stats->polluting_prefetches_l1++;
+    }
+    l1_fill<POLICY, VICTIM, L2, L1_WAYS>(l1_index, l1_tag, rw == 'W', false, stats);
+    if (l1_prefetcher.enabled()) {
+        l1_prefetch<POLICY, VICTIM, L2, L1_WAYS>(l1_block_addr, stats);
+    }
+}
 
-            else {
-                #ifdef DEBUG
-                printf("%d: L2 read miss\n", stats->accesses_l1-1);
-                #endif            
-                stats->read_misses_l2++;
-
-                if (m_config.l2_config.enable_ER) {
-                    uint64_t word_offset = (addr & ((1 << m_config.l2_config.b) - 1)) / WORD_SIZE;
-                    early_restart_offset_sum += word_offset;
-                    early_restart_offset_count++;
-                }
-        
-                if (true) {
-                    int invalidIndexInL2 = -1;
-                    for (int i = 0; i < l2_set.size(); i++) {
-                        if (l2_set[i].valid == false) {
-                            invalidIndexInL2 = i;
-                            break;
-                        }
-                    }
-                    if (invalidIndexInL2 == -1) {
-                        // Delete L2 Victim block:
-                        switch (m_config.l2_config.replace_policy)
-                        {
-                            case REPLACEMENT_POLICY_MIP:
-                            case REPLACEMENT_POLICY_LIP:
-                            case REPLACEMENT_POLICY_FIFO:
-                                invalidIndexInL2 = l2_set.size()-1;
-                                break;
-                            case REPLACEMENT_POLICY_RANDOM:
-                                if (m_config.l2_config.s == 0) invalidIndexInL2 = 0;
-                                else invalidIndexInL2 = (evict_random() % ((1 << m_config.l2_config.s)- 1));
-                                break;
-                            default:
-                                break;          
-                        }
-                    }
-                    #ifdef DEBUG
-                    // printf("L1 decomposed address 0x%lx -> Tag: 0x%lx and Index: 0x%lx\n", addr, l1_victim_tag, l1_victim_index);
-                    printf("Evict from L2: block with valid=%d and index=0x%lx\n", l2_set[invalidIndexInL2].valid, l2_index);
-                    #endif
-                    l2_set.erase(l2_set.begin() + invalidIndexInL2);
-        
-                    // Create a new cache block to insert
-                    CacheBlock l2NewCacheBlock;
-                    l2NewCacheBlock.dirty = false;
-                    l2NewCacheBlock.valid = true;
-                    l2NewCacheBlock.tag = l2_tag;
-        
-                    switch (m_config.l2_config.replace_policy)
-                    {
-                        case REPLACEMENT_POLICY_MIP:
-                            l2_set.insert(l2_set.begin(), l2NewCacheBlock);
-                            break;
-                        case REPLACEMENT_POLICY_LIP:
-                            l2_set.insert(l2_set.end(), l2NewCacheBlock);
-                            break;
-                        case REPLACEMENT_POLICY_FIFO:
-                            l2_set.insert(l2_set.begin(), l2NewCacheBlock);
-                            break;
-                        case REPLACEMENT_POLICY_RANDOM:
-                            l2_set.insert(l2_set.end(), l2NewCacheBlock);
-                            break;
-                        default:
-                            break;          
-                    } 
-                }
-            }
+// Fetches the blocks the L1 prefetcher asks for after a demand miss on
+// block_addr. Each reads L2 like a miss would, counted apart from the demand
+// reads.
+template <replacement_policy_t POLICY, bool VICTIM, l2_storage_t L2, int L1_WAYS>
+void Simulator::l1_prefetch(uint64_t block_addr, sim_stats_t *stats) {
+    uint64_t blocks[PREFETCH_MAX_DEGREE];
+    unsigned n = l1_prefetcher.train(block_addr, blocks);
+    for (unsigned i = 0; i < n; i++) {
+        if (blocks[i] >> (64 - l1_block_offset_bits)) {
+            // Past either end of the address space
+            continue;
         }
-        // Insert the block to L1 Cache
-        CacheBlock newBlock;
-        newBlock.dirty = ((rw == 'W') || victimDirty);
-        newBlock.valid = true;
-        newBlock.tag = l1_victim_tag;        
-
-        // Judge: Any element in L1 set invalid?
-        int invalidIndexInL1 = -1;
-        for (int i = 0; i < l1_set.size(); i++) {
-            if (l1_set[i].valid == false) {
-                invalidIndexInL1 = i;
-                break;
-            }
+        uint64_t index = blocks[i] & l1_index_mask;
+        uint64_t tag = blocks[i] >> l1_index_bits;
+        if (L1_cache.lookup<L1_WAYS>(index, tag) != -1 || (VICTIM && victim_cache.lookup(blocks[i]) != -1)) {
+            continue;
         }
+        uint64_t read_hits = stats->read_hits_l2;
+        uint64_t read_misses = stats->read_misses_l2;
+        l1_prefetch_read = true;
+        l2_read<POLICY, L2>(blocks[i] << l1_block_offset_bits, stats);
+        l1_prefetch_read = false;
+        bool missed = stats->read_misses_l2 != read_misses;
+        stats->read_hits_l2 = read_hits;
+        stats->read_misses_l2 = read_misses;
+        stats->prefetch_reads_l2++;
+        stats->prefetch_read_misses_l2 += missed;
+        stats->prefetches_l1++;
+        double latency = (L2 == L2_NONE ? 0 : hit_time_l2) + (missed ? dram_time : 0);
+        l1_prefetches.ready_at[blocks[i]] = cycles(stats) + latency;
+        l1_fill<POLICY, VICTIM, L2, L1_WAYS>(index, tag, false, true, stats);
+    }
+}
 
-        if (invalidIndexInL1 != -1) {
-            // Move to MRU
-            l1_set.erase(l1_set.begin() + invalidIndexInL1);
-            l1_set.insert(l1_set.begin(), newBlock);
-            return;
-        }
-        else {
-            if (m_config.victim_cache_entries > 0) {
-                int victimIndexInL1 = l1_set.size()-1;
-                VictimBlock nvBlock;
-                nvBlock.dirty = l1_set[victimIndexInL1].dirty;
-                nvBlock.valid = l1_set[victimIndexInL1].valid;
-                nvBlock.tag = l1_set[victimIndexInL1].tag;
-                nvBlock.index = l1_victim_index;   
-
-                // Insert nvBlock to victim cache
-                int victimInvalidIndex = -1;
-                for (int i = 0; i < victim_cache.size(); i++) {
-                    if (!victim_cache[i].valid) {
-                        victimInvalidIndex = i;
-                        break;
-                    }
-                }
-                if (victimInvalidIndex != -1) {
-                    victim_cache.erase(victim_cache.begin() + victimInvalidIndex);
-                    victim_cache.insert(victim_cache.begin(), nvBlock);
-                }
-                else {
-                    victimInvalidIndex = victim_cache.size()-1;
-                    if (victim_cache[victimInvalidIndex].dirty) {
-                        stats->write_backs_l1_or_victim_cache++;
-                        stats->writes_l2++;
-                    }
-                    // Try inserting this block to L2 Cache!
-                    if (!m_config.l2_config.disabled) {
-                        uint64_t victim_block_tag = victim_cache[victimInvalidIndex].tag;
-                        uint64_t victim_block_index = victim_cache[victimInvalidIndex].index;
-                        uint64_t victim_block_addr_except_offset = (victim_block_tag << (m_config.l1_config.c - m_config.l1_config.b - m_config.l1_config.s)) | victim_block_index;
-                        uint64_t victim_block_l2_tag = victim_block_addr_except_offset >> (m_config.l2_config.c - m_config.l2_config.b - m_config.l2_config.s);
-                        uint64_t victim_block_l2_index = victim_block_addr_except_offset & ((1 << (m_config.l2_config.c - m_config.l2_config.b - m_config.l2_config.s))-1);
-                        if (victim_cache[victimInvalidIndex].dirty) {
-                                
-                            CacheSet& l2_victim_set = L2_cache[victim_block_l2_index];
-                            int foundId = -1;
-                            for (int i = 0; i < l2_victim_set.size(); i++) {
-                                if (l2_victim_set[i].tag == victim_block_l2_tag) {
-                                    foundId = i;
-                                    break;
-                                }
-                            }
-                            if (foundId != -1) {
-                                CacheBlock newBlock_l2 = l2_victim_set[foundId];
-                                switch (m_config.l2_config.replace_policy)
-                                {
-                                    case REPLACEMENT_POLICY_MIP:
-                                        l2_victim_set.erase(l2_victim_set.begin() + foundId);
-                                        l2_victim_set.insert(l2_victim_set.begin(), newBlock_l2);   
-                                        break;
-                                    case REPLACEMENT_POLICY_LIP:
-                                        l2_victim_set.erase(l2_victim_set.begin() + foundId);
-                                        l2_victim_set.insert(l2_victim_set.begin(), newBlock_l2);   
-                                        break;
-                                    case REPLACEMENT_POLICY_FIFO:
-                                        break;
-                                    case REPLACEMENT_POLICY_RANDOM:
-                                        break;
-                                    default:
-                                        break;          
-                                }
-                                #ifdef DEBUG
-                                // printf("%d: In L2, moving Tag: 0x%" PRIx64 " and Index: 0x%" PRIx64 " to MRU position\n", stats->accesses_l1-1, l2_victim_set[0].tag, l2_index);
-                                #endif
-                            }
-                            else {
-                                // Write to DRAM        
-                            }
-                        }
-                    }
-                    victim_cache.erase(victim_cache.begin() + victimInvalidIndex);
-                    victim_cache.insert(victim_cache.begin(), nvBlock);
-                }
-
-                l1_set.erase(l1_set.begin() + victimIndexInL1);
-                l1_set.insert(l1_set.begin(), newBlock);
-                return;
-            }
-            else {
-                // Switch L1 victim to L2!
-                // MRU: switch last element in L1 cache block
-                int victimIndex = l1_set.size()-1;
-                #ifdef DEBUG
-                printf("%d: Evict from L1: block with valid=%d, dirty=%d, tag 0x%lx, and index=0x%lx\n", stats->accesses_l1-1, l1_set[victimIndex].valid, l1_set[victimIndex].dirty, l1_set[victimIndex].tag, victimIndex);
-                #endif
-                if (l1_set[victimIndex].dirty) {
-                    stats->write_backs_l1_or_victim_cache++;
-                    stats->writes_l2++;
-                    if (!m_config.l2_config.disabled) {
-                        int l1VictimIndex = l1_set.size()-1;
-                        uint64_t l1_tag = l1_set[l1VictimIndex].tag;
-                        uint64_t l1_addr_except_offset = (l1_tag << (m_config.l1_config.c - m_config.l1_config.b - m_config.l1_config.s)) | l1_victim_index;
-                        uint64_t l2_tag = l1_addr_except_offset >> (m_config.l2_config.c - m_config.l2_config.b - m_config.l2_config.s);
-                        uint64_t l2_index = l1_addr_except_offset & ((1 << (m_config.l2_config.c - m_config.l2_config.b - m_config.l2_config.s))-1);
-                        
-                        CacheSet& l2_victim_set = L2_cache[l2_index];
-                        int foundId = -1;
-                        for (int i = 0; i < l2_victim_set.size(); i++) {
-                            if (l2_victim_set[i].tag == l2_tag) {
-                                foundId = i;
-                                break;
-                            }
-                        }
-                        if (foundId != -1) {
-                            CacheBlock newBlock_l2 = l2_victim_set[foundId];
-                            switch (m_config.l2_config.replace_policy)
-                            {
-                                case REPLACEMENT_POLICY_MIP:
-                                    l2_victim_set.erase(l2_victim_set.begin() + foundId);
-                                    l2_victim_set.insert(l2_victim_set.begin(), newBlock_l2);   
-                                    break;
-                                case REPLACEMENT_POLICY_LIP:
-                                    l2_victim_set.erase(l2_victim_set.begin() + foundId);
-                                    l2_victim_set.insert(l2_victim_set.begin(), newBlock_l2);   
-                                    break;
-                                case REPLACEMENT_POLICY_FIFO:
-                                    break;
-                                case REPLACEMENT_POLICY_RANDOM:
-                                    break;
-                                default:
-                                    break;          
-                            }
-
-                            #ifdef DEBUG
-                            // printf("%d: In L2, moving Tag: 0x%" PRIx64 " and Index: 0x%" PRIx64 " to MRU position\n", stats->accesses_l1-1, l2_victim_set[0].tag, l2_index);
-                            #endif
-                        }
-                        else {
-                            // Write to DRAM        
-                        }
-                    }
-                }
-                l1_set.erase(l1_set.begin() + victimIndex);
-                l1_set.insert(l1_set.begin(), newBlock);
+// Puts a block in its L1 set at the front, moving the set's LRU block to the
+// victim cache or writing it back when the set is full
+template <replacement_policy_t POLICY, bool VICTIM, l2_storage_t L2, int L1_WAYS>
+void Simulator::l1_fill(uint64_t l1_index, uint64_t l1_tag, bool dirty, bool prefetched, sim_stats_t *stats) {
+    if (l1_prefetcher.enabled()) {
+        l1_prefetches.refilled(l1_tag << l1_index_bits | l1_index);
+    }
+    int free = L1_cache.free_way(l1_index);
+    if (free != -1) {
+        // Move to MRU
+        L1_cache.fill<L1_WAYS>(l1_index, free, l1_tag, dirty, prefetched);
+        L1_cache.to_front<L1_WAYS>(l1_index, free);
+        profile_lap(PROFILE_L1_FILL);
+        return;
+    }
+
+    int lru = L1_cache.back_way<L1_WAYS>(l1_index);
+    uint64_t lru_block_addr = (L1_cache.tags[L1_cache.base<L1_WAYS>(l1_index) + lru] << l1_index_bits) | l1_index;
+    bool lru_dirty = L1_cache.dirty<L1_WAYS>(l1_index, lru);
+    #ifdef DEBUG
+    printf("%" PRIu64 ": Evict from L1: block with dirty=%d, tag 0x%" PRIx64 ", and index=0x%" PRIx64 "\n", stats->accesses_l1-1, lru_dirty, L1_cache.tags[L1_cache.base<L1_WAYS>(l1_index) + lru], l1_index);
+    #endif
+    if (VICTIM) {
+        // Insert the L1 victim into the victim cache, pushing out its LRU block
+        int vc_way = victim_cache.free_way();
+        if (vc_way == -1) {
+            vc_way = victim_cache.back_way();
+            if (victim_cache.dirty(vc_way)) {
+                l1_write_back<POLICY, L2>(victim_cache.block(vc_way), stats);
             }
         }
+        victim_cache.fill(vc_way, lru_block_addr, lru_dirty);
+        victim_cache.to_front(vc_way);
+    }
+    else if (lru_dirty) {
+        // Switch L1 victim to L2!
+        l1_write_back<POLICY, L2>(lru_block_addr, stats);
+    }
+    if (l1_prefetcher.enabled()) {
+        prefetch_evicted(l1_prefetches, lru_block_addr, L1_cache.prefetched<L1_WAYS>(l1_index, lru), prefetched,
+                         &stats->unused_prefetches_l1);
+    }
+    L1_cache.fill<L1_WAYS>(l1_index, lru, l1_tag, dirty, prefetched);
+    L1_cache.to_front<L1_WAYS>(l1_index, lru);
+    profile_lap(PROFILE_L1_FILL);
+}
+
+void Simulator::record_l2_stream(trace_buffer_t *stream) {
+    l2_stream = stream;
+    l2_stream_lost = false;
+}
+
+void Simulator::record_l2(char rw, uint64_t addr) {
+    if (trace_buffer_append(l2_stream, rw, addr)) {
+        l2_stream = NULL;
+        l2_stream_lost = true;
+    }
+}
+
+void Simulator::access_l2(char rw, uint64_t addr, sim_stats_t *stats) {
+    profile_begin();
+    if (rw == READ) {
+        (this->*l2_read_fn)(addr, stats);
+    }
+    else {
+        (this->*l2_write_back_fn)(addr >> l1_block_offset_bits, stats);
+        profile_lap(PROFILE_WRITE_BACK);
     }
 }
 
 /**
  * Subroutine for cleaning up any outstanding memory operations and calculating overall statistics
  * such as miss rate or average access time.
- * TODO: You're responsible for completing this routine
  */
-void sim_finish(sim_stats_t *stats) {
+void Simulator::finish(sim_stats_t *stats) {
     stats->hit_ratio_l1 = 1.0 * stats->hits_l1 / stats->accesses_l1;
     stats->miss_ratio_l1 = 1 - stats->hit_ratio_l1;
     stats->hit_ratio_victim_cache = 1.0 * stats->hits_victim_cache / (stats->hits_victim_cache + stats->misses_victim_cache);
     stats->miss_ratio_victim_cache = 1.0 * stats->misses_victim_cache / (stats->hits_victim_cache + stats->misses_victim_cache);
     stats->read_hit_ratio_l2 = 1.0 * stats->read_hits_l2 / stats->reads_l2;
     stats->read_miss_ratio_l2 = 1 - stats->read_hit_ratio_l2;
-    double hit_time_l1 = L1_HIT_TIME_CONST + (m_config.l1_config.s * L1_HIT_TIME_PER_S);
-    double hit_time_l2 = L2_HIT_TIME_CONST + (m_config.l2_config.s * L2_HIT_TIME_PER_S);
 
     double average_early_restart_offset;
     if (m_config.l2_config.enable_ER && early_restart_offset_count > 0) {
         average_early_restart_offset = (double) early_restart_offset_sum / early_restart_offset_count;
     } else {
-        average_early_restart_offset = (1 << m_config.l2_config.b) / WORD_SIZE;
+        average_early_restart_offset = ((uint64_t)1 << m_config.l2_config.b) / WORD_SIZE;
     }
 
+    // The ratios of a level nothing reached are 0/0 and stay NaN, but the
+    // AATs are still defined: a run (or a sampled window) that never missed
+    // L1 takes the L1 hit time, and an L2 nothing read takes its hit time
+    bool missed_l1 = stats->hits_victim_cache + stats->misses_victim_cache > 0;
+    // Only misses that read below L1 wait for it; posted write misses do not
+    double read_miss_ratio_victim_cache = 1.0 * (stats->misses_victim_cache - stats->posted_write_misses_l1)
+                                          / (stats->hits_victim_cache + stats->misses_victim_cache);
     if (!m_config.l2_config.disabled) {
-        double dram_time = DRAM_AT + (DRAM_AT_PER_WORD * (1 << m_config.l2_config.b) / WORD_SIZE);
         double dram_time_er = DRAM_AT + (DRAM_AT_PER_WORD * average_early_restart_offset);
-        if (m_config.l2_config.enable_ER) {
+        stats->avg_access_time_l2 = hit_time_l2;
+        if (stats->reads_l2 && m_config.l2_config.enable_ER) {
             stats->avg_access_time_l2 = hit_time_l2 + stats->read_miss_ratio_l2 * dram_time_er;
-        } else {
+        } else if (stats->reads_l2) {
             stats->avg_access_time_l2 = hit_time_l2 + stats->read_miss_ratio_l2 * dram_time;
         }
-        stats->avg_access_time_l1 = hit_time_l1 + (stats->miss_ratio_victim_cache * stats->miss_ratio_l1 * stats->avg_access_time_l2);
+        stats->avg_access_time_l1 = hit_time_l1;
+        if (missed_l1) {
+            stats->avg_access_time_l1 = hit_time_l1 + (read_miss_ratio_victim_cache * stats->miss_ratio_l1 * stats->avg_access_time_l2);
+        }
     }
     else {
-        stats->avg_access_time_l2 = DRAM_AT + DRAM_AT_PER_WORD * (1 << m_config.l2_config.b) / WORD_SIZE;
-        stats->avg_access_time_l1 = hit_time_l1 + stats->miss_ratio_l1 * stats->miss_ratio_victim_cache * stats->avg_access_time_l2;
+        stats->avg_access_time_l2 = DRAM_AT + DRAM_AT_PER_WORD * ((uint64_t)1 << m_config.l2_config.b) / WORD_SIZE;
+        stats->avg_access_time_l1 = hit_time_l1;
+        if (missed_l1) {
+            stats->avg_access_time_l1 = hit_time_l1 + stats->miss_ratio_l1 * read_miss_ratio_victim_cache * stats->avg_access_time_l2;
+        }
+    }
+
+    // Time spent waiting on a full write buffer, spread over every access
+    stats->avg_access_time_l1 += stats->write_buffer_stall_cycles / stats->accesses_l1;
+    stats->dram_write_bandwidth = stats->writes_dram * (double)((uint64_t)1 << m_config.l2_config.b) / cycles(stats);
+
+    stats->prefetch_accuracy_l1 = 1.0 * stats->useful_prefetches_l1 / stats->prefetches_l1;
+    stats->prefetch_coverage_l1 = 1.0 * stats->useful_prefetches_l1 / (stats->useful_prefetches_l1 + stats->misses_l1);
+    stats->prefetch_accuracy_l2 = 1.0 * stats->useful_prefetches_l2 / stats->prefetches_l2;
+    stats->prefetch_coverage_l2 = 1.0 * stats->useful_prefetches_l2
+                                  / (stats->useful_prefetches_l2 + stats->read_misses_l2 + stats->prefetch_read_misses_l2);
+}
+
+void Simulator::merge_shard(const Simulator &shard) {
+    early_restart_offset_sum += shard.early_restart_offset_sum;
+    early_restart_offset_count += shard.early_restart_offset_count;
+}
+
+// The C API drives a single process-wide simulator that shares its RANDOM
+// generator with evict_random()/evict_srand()
+static Simulator global_simulator(&evict_random_next);
+
+void sim_setup(sim_config_t *config) {
+    global_simulator.setup(*config);
+}
+
+void sim_access(char rw, uint64_t addr, sim_stats_t* stats) {
+    global_simulator.access(rw, addr, stats);
+}
+
+void sim_access_batch(const access_t *accesses, size_t count, sim_stats_t *stats) {
+    global_simulator.access_batch(accesses, count, stats);
+}
+
+void sim_warm_batch(const access_t *accesses, size_t count) {
+    global_simulator.warm_batch(accesses, count);
+}
+
+void sim_finish(sim_stats_t *stats) {
+    global_simulator.finish(stats);
+}
+
+// Every count in sim_stats_t
+static uint64_t sim_stats_t::*const STATS_COUNTS[] = {
+    &sim_stats_t::reads, &sim_stats_t::writes, &sim_stats_t::accesses_l1, &sim_stats_t::reads_l2,
+    &sim_stats_t::writes_l2, &sim_stats_t::write_backs_l1_or_victim_cache, &sim_stats_t::hits_l1,
+    &sim_stats_t::hits_victim_cache, &sim_stats_t::read_hits_l2, &sim_stats_t::misses_l1,
+    &sim_stats_t::misses_victim_cache, &sim_stats_t::read_misses_l2, &sim_stats_t::cumulative_l2_mp,
+    &sim_stats_t::write_hits_l2, &sim_stats_t::write_misses_l2, &sim_stats_t::posted_write_misses_l1,
+    &sim_stats_t::write_backs_l2,
+    &sim_stats_t::writes_dram, &sim_stats_t::write_buffer_merges, &sim_stats_t::write_buffer_stalls,
+    &sim_stats_t::prefetches_l1, &sim_stats_t::useful_prefetches_l1, &sim_stats_t::late_prefetches_l1,
+    &sim_stats_t::unused_prefetches_l1, &sim_stats_t::polluting_prefetches_l1, &sim_stats_t::prefetches_l2,
+    &sim_stats_t::useful_prefetches_l2, &sim_stats_t::late_prefetches_l2, &sim_stats_t::unused_prefetches_l2,
+    &sim_stats_t::polluting_prefetches_l2, &sim_stats_t::prefetch_reads_l2, &sim_stats_t::prefetch_read_misses_l2,
+};
+
+void sim_stats_add(sim_stats_t *stats, const sim_stats_t *part) {
+    for (auto count : STATS_COUNTS) {
+        stats->*count += part->*count;
+    }
+    stats->write_buffer_stall_cycles += part->write_buffer_stall_cycles;
+}
+
+void sim_stats_subtract(sim_stats_t *stats, const sim_stats_t *part) {
+    for (auto count : STATS_COUNTS) {
+        stats->*count -= part->*count;
     }
+    stats->write_buffer_stall_cycles -= part->write_buffer_stall_cycles;
+}
+
+void sim_stats_scale(sim_stats_t *stats, double scale) {
+    for (auto count : STATS_COUNTS) {
+        stats->*count = llround(stats->*count * scale);
+    }
+    stats->write_buffer_stall_cycles *= scale;
+}
+
+int sim_save_checkpoint(const char *path, uint64_t trace_offset) {
+    return global_simulator.save_checkpoint(path, trace_offset);
+}
+
+int sim_load_checkpoint(const char *path, uint64_t *trace_offset) {
+    return global_simulator.load_checkpoint(path, trace_offset);
+}
+
+int sim_plan_opt(trace_file_t *trace) {
+    return global_simulator.plan_opt(trace);
+}
+
+const sim_profile_t *sim_profile(void) {
+    return &global_simulator.profile();
 }
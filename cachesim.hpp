@@ -3,6 +3,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 
 // Replacement policy
 typedef enum replacement_policy {
@@ -15,6 +16,17 @@ typedef enum replacement_policy {
     // Uses PRNG to randomly choose a block to evict and insert new block.
     // Check the assignment PDF for more info
     REPLACEMENT_POLICY_RANDOM,
+    // Binary tree pseudo-LRU, one bit per internal node
+    REPLACEMENT_POLICY_TREE_PLRU,
+    // Static re-reference interval prediction, 2-bit RRPVs, inserting at 2
+    REPLACEMENT_POLICY_SRRIP,
+    // Bimodal RRIP: inserts at 3, and at 2 one time in 32
+    REPLACEMENT_POLICY_BRRIP,
+    // Dynamic RRIP: SRRIP or BRRIP, picked by set dueling
+    REPLACEMENT_POLICY_DRRIP,
+    // Belady's OPT: evicts the block read again farthest in the future. Needs
+    // the trace ahead of time, see opt.hpp
+    REPLACEMENT_POLICY_OPT,
 } replacement_policy_t;
 
 typedef enum write_strat {
@@ -24,6 +36,25 @@ typedef enum write_strat {
     WRITE_STRAT_WTWNA,
 } write_strat_t;
 
+// Hardware prefetcher, trained on a level's demand misses, see prefetch.hpp
+typedef enum prefetcher {
+    PREFETCHER_NONE,
+    // The blocks just past the miss
+    PREFETCHER_NEXT_LINE,
+    // A stride per memory region, once it repeats
+    PREFETCHER_STRIDE,
+    // Ascending or descending runs of misses
+    PREFETCHER_STREAM,
+} prefetcher_t;
+
+typedef struct prefetch_config {
+    prefetcher_t kind;
+    // Blocks fetched per trigger
+    uint64_t degree;
+    // How many blocks (or strides) ahead of the miss the first one is
+    uint64_t distance;
+} prefetch_config_t;
+
 typedef struct cache_config {
     bool disabled;
     // (C,B,S) in the Conte Cache Taxonomy (Patent Pending)
@@ -33,12 +64,28 @@ typedef struct cache_config {
     replacement_policy_t replace_policy;
     write_strat_t write_strat;
     bool enable_ER;
+    // Materialize sets on first touch and bit-pack the tags, for very large
+    // caches. Only the L2 honours it.
+    bool sparse;
 } cache_config_t;
 
+// The coalescing write buffer in front of DRAM
+typedef struct write_buffer_config {
+    // Blocks it holds; 0 for none, when DRAM writes are only counted
+    uint64_t entries;
+    // Cycles DRAM takes to retire each entry, oldest first
+    double drain_cycles;
+    // A write to a block already queued joins it instead of taking an entry
+    bool merge;
+} write_buffer_config_t;
+
 typedef struct sim_config {
     cache_config_t l1_config;
     uint64_t victim_cache_entries;
     cache_config_t l2_config;
+    write_buffer_config_t write_buffer;
+    prefetch_config_t prefetch_l1;
+    prefetch_config_t prefetch_l2;
 } sim_config_t;
 
 typedef struct sim_stats {
@@ -64,11 +111,72 @@ typedef struct sim_stats {
     double avg_access_time_l1;
     double avg_access_time_l2;
     double averaged_miss_penalty_l2;
+    // Write traffic below L1. A write to L2 is an L1 or victim cache
+    // write-back, or an L1 write-through.
+    uint64_t write_hits_l2;
+    uint64_t write_misses_l2;
+    // Write misses a write-through L1 passed down without allocating. They
+    // miss the victim cache too, but read nothing, so the AAT leaves them out.
+    uint64_t posted_write_misses_l1;
+    // Dirty blocks evicted from a write-back L2
+    uint64_t write_backs_l2;
+    // Blocks written to DRAM, after merging in the write buffer
+    uint64_t writes_dram;
+    uint64_t write_buffer_merges;
+    // Writes that found the write buffer full, and the cycles they waited
+    uint64_t write_buffer_stalls;
+    double write_buffer_stall_cycles;
+    // DRAM write bytes per cycle of the modelled run time
+    double dram_write_bandwidth;
+    // Prefetching at each level: blocks prefetched; those a demand access
+    // then used (at L2, L1 prefetch reads count too), late when it came
+    // before their fill could have finished; those evicted unused; and
+    // demand misses on blocks a prefetch evicted
+    uint64_t prefetches_l1;
+    uint64_t useful_prefetches_l1;
+    uint64_t late_prefetches_l1;
+    uint64_t unused_prefetches_l1;
+    uint64_t polluting_prefetches_l1;
+    uint64_t prefetches_l2;
+    uint64_t useful_prefetches_l2;
+    uint64_t late_prefetches_l2;
+    uint64_t unused_prefetches_l2;
+    uint64_t polluting_prefetches_l2;
+    // L2 reads on behalf of L1 prefetches, kept out of the demand counts
+    uint64_t prefetch_reads_l2;
+    uint64_t prefetch_read_misses_l2;
+    // Useful over issued, and useful over useful plus the misses left
+    double prefetch_accuracy_l1;
+    double prefetch_coverage_l1;
+    double prefetch_accuracy_l2;
+    double prefetch_coverage_l2;
 } sim_stats_t;
 
+// One trace record
+typedef struct access {
+    uint64_t addr;
+    char rw;
+} access_t;
+
 extern void sim_setup(sim_config_t *config);
 extern void sim_access(char rw, uint64_t addr, sim_stats_t* p_stats);
+// Same as calling sim_access() on each record in order
+extern void sim_access_batch(const access_t *accesses, size_t count, sim_stats_t *p_stats);
+// Updates cache contents and recency like sim_access_batch() but counts
+// nothing, for warming up state between sampled measurement windows
+extern void sim_warm_batch(const access_t *accesses, size_t count);
 extern void sim_finish(sim_stats_t *p_stats);
+// Adds or subtracts the counts of part, leaving the ratios and times for
+// sim_finish()
+extern void sim_stats_add(sim_stats_t *p_stats, const sim_stats_t *part);
+extern void sim_stats_subtract(sim_stats_t *p_stats, const sim_stats_t *part);
+// Multiplies every count by scale, rounding to the nearest
+extern void sim_stats_scale(sim_stats_t *p_stats, double scale);
+
+// Saves or restores the cache state (not the statistics) together with the
+// number of trace records behind it. Return nonzero on failure.
+extern int sim_save_checkpoint(const char *path, uint64_t trace_offset);
+extern int sim_load_checkpoint(const char *path, uint64_t *trace_offset);
 
 extern int evict_random(void);
 extern void evict_srand(unsigned int seed);
@@ -82,7 +190,8 @@ static const sim_config_t DEFAULT_SIM_CONFIG = {
                       /*.s =*/ 1,  // 2-way
                       /*.replace_policy =*/ REPLACEMENT_POLICY_MIP,
                       /*.write_strat =*/ WRITE_STRAT_WBWA,
-                      /*.enable early restart =*/ 0},
+                      /*.enable early restart =*/ 0,
+                      /*.sparse =*/ 0},
 
     /*.victim_cache_entries =*/ 2,
 
@@ -92,7 +201,15 @@ static const sim_config_t DEFAULT_SIM_CONFIG = {
                       /*.s =*/ 3,  // 8-way
                       /*.replace_policy =*/ REPLACEMENT_POLICY_LIP,
                       /*.write_strat =*/ WRITE_STRAT_WTWNA,
-                      /*.enable early restart =*/ 0}
+                      /*.enable early restart =*/ 0,
+                      /*.sparse =*/ 0},
+
+    /*.write_buffer =*/ {/*.entries =*/ 0,
+                         /*.drain_cycles =*/ 0, // One DRAM block write
+                         /*.merge =*/ 1},
+
+    /*.prefetch_l1 =*/ {/*.kind =*/ PREFETCHER_NONE, /*.degree =*/ 1, /*.distance =*/ 1},
+    /*.prefetch_l2 =*/ {/*.kind =*/ PREFETCHER_NONE, /*.degree =*/ 1, /*.distance =*/ 1}
 };
 
 // Argument to cache_access rw. Indicates a load
@@ -0,0 +1,90 @@
+#include <stdio.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "trace.hpp"
+
+static void print_help(void) {
+    printf("cachesim-convert [OPTIONS] INPUT.trace OUTPUT\n");
+    printf("Converts a text trace into the binary format read by cachesim.\n");
+    printf("INPUT may be - to read the text trace from stdin.\n");
+    printf("-f\t\tStore fixed 8-byte records instead of delta varints\n");
+    printf("-h\t\tThis helpful output\n");
+}
+
+int main(int argc, char **argv) {
+    trace_encoding_t encoding = TRACE_ENCODING_VARINT;
+    int opt;
+
+    while(-1 != (opt = getopt(argc, argv, "fh"))) {
+        switch(opt) {
+        case 'f':
+            encoding = TRACE_ENCODING_FIXED;
+            break;
+        case 'h':
+            /* Fall through */
+        default:
+            print_help();
+            return 0;
+        }
+    }
+    if (argc - optind != 2) {
+        print_help();
+        return 1;
+    }
+
+    const char *in_path = argv[optind];
+    const char *out_path = argv[optind + 1];
+    FILE *in = strcmp(in_path, "-") ? fopen(in_path, "r") : stdin;
+    if (!in) {
+        printf("Could not open `%s'\n", in_path);
+        return 1;
+    }
+    FILE *out = fopen(out_path, "wb");
+    if (!out) {
+        printf("Could not create `%s'\n", out_path);
+        return 1;
+    }
+
+    // The record count is patched in once the input is exhausted
+    trace_header_t header;
+    trace_make_header(&header, encoding, 0);
+    fwrite(&header, sizeof header, 1, out);
+
+    char line[256];
+    uint8_t buf[TRACE_MAX_RECORD_SIZE];
+    uint64_t records = 0;
+    uint64_t prev_addr = 0;
+    uint64_t bytes = 0;
+    while (fgets(line, sizeof line, in)) {
+        char rw;
+        uint64_t addr;
+        if (sscanf(line, "%c 0x%" SCNx64, &rw, &addr) != 2) {
+            continue;
+        }
+        if (encoding == TRACE_ENCODING_FIXED && (addr >> 63)) {
+            printf("Address 0x%" PRIx64 " does not fit a fixed record, drop -f\n", addr);
+            fclose(out);
+            unlink(out_path);
+            return 1;
+        }
+        size_t n = trace_encode_record(encoding, rw, addr, prev_addr, buf);
+        fwrite(buf, 1, n, out);
+        bytes += n;
+        prev_addr = addr;
+        records++;
+    }
+
+    trace_make_header(&header, encoding, records);
+    if (fseek(out, 0, SEEK_SET) || fwrite(&header, sizeof header, 1, out) != 1 || fclose(out)) {
+        printf("Could not write `%s'\n", out_path);
+        return 1;
+    }
+    if (in != stdin) {
+        fclose(in);
+    }
+
+    printf("%" PRIu64 " records, %.2f bytes per record\n", records, records ? (double)bytes / records : 0.0);
+    return 0;
+}
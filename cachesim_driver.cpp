@@ -3,94 +3,881 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <getopt.h>
+#include <math.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
 #include "cachesim.hpp"
+#include "simulator.hpp"
+#include "all_assoc.hpp"
+#include "mrc.hpp"
+#include "trace.hpp"
+#include "trace_pipeline.hpp"
+#include "profile.hpp"
+#include "stats_stream.hpp"
+#include "shard.hpp"
+#include "timing.hpp"
+#include "hierarchy.hpp"
+#include "multicore.hpp"
 
 static void print_help(void);
+static int parse_config_option(int opt, const char *arg, sim_config_t *config);
 static int parse_replace_policy(const char *arg, replacement_policy_t *policy_out);
+static int parse_write_strat(const char *arg, write_strat_t *strat_out);
+static int parse_write_buffer(const char *arg, write_buffer_config_t *buffer);
+static int parse_timing_pair(const char *arg, const char *name, unsigned *first, unsigned *second);
+static int parse_prefetch(const char *arg, const char *name, prefetch_config_t *prefetch);
 static int validate_config(sim_config_t *config);
+static bool uses_opt(const sim_config_t *config);
+static void print_settings(sim_config_t *config);
 static void print_cache_config(cache_config_t *cache_config, const char *cache_name);
 static void print_statistics(sim_stats_t* stats);
+static bool models_writes(const sim_config_t *config);
+static void print_write_traffic(const sim_stats_t *stats);
+static bool prefetches(const sim_config_t *config);
+static void print_prefetching(const sim_stats_t *stats, const sim_stats_t *baseline);
+static int run_timing(sim_config_t *config, const timing_config_t *timing, trace_file_t *trace);
+static void print_timing(const timing_config_t *timing, const timing_stats_t *stats);
+static void print_profile(const sim_profile_t *profile, double ticks_per_ns,
+                          double read_ns, double sim_ns, uint64_t accesses);
+static int run_sweep(const char *grid_path, trace_file_t *trace);
+static int run_l2_replay(const char *grid_path, trace_file_t *trace);
+static int run_all_assoc(const char *range, uint64_t b, trace_file_t *trace);
+static int run_mrc(const char *range, uint64_t b, trace_file_t *trace);
+static int read_hierarchy(const char *path, hierarchy_config_t *config);
+static int run_hierarchy(const char *path, trace_file_t *trace);
+static int run_multicore(sim_config_t *config, const std::vector<const char *> &paths, unsigned jobs, uint64_t epoch);
+
+/* Mean and variance of a per-window metric, updated one window at a time */
+typedef struct running_stat {
+    uint64_t n;
+    double mean;
+    double m2;
+} running_stat_t;
+
+/*
+ * --sample=PERIOD,WARMUP,DETAIL: every PERIOD records, skip the first
+ * PERIOD - WARMUP - DETAIL, warm the caches with the next WARMUP and
+ * measure the last DETAIL
+ */
+typedef struct sampling {
+    uint64_t period;
+    uint64_t warmup;
+    uint64_t detail;
+    uint64_t position;
+    uint64_t measured;
+    sim_stats_t window;
+    running_stat_t l1_miss_ratio;
+    running_stat_t l2_miss_ratio;
+    running_stat_t aat;
+} sampling_t;
+
+static int parse_sampling(const char *arg, sampling_t *sampling);
+static void sample_batch(sampling_t *sampling, const access_t *records, size_t count, sim_stats_t *stats);
+static int finish_sampling(sampling_t *sampling, sim_stats_t *stats);
+static void print_sampling(const sampling_t *sampling);
+
+/* Blocks tracked by --mrc unless given */
+static const unsigned MRC_DEFAULT_SAMPLES = 16384;
+
+/* Options that describe the simulated hierarchy, shared with sweep grids */
+static const char CONFIG_OPTSTRING[] = "c:b:s:v:C:S:P:DELw:W:";
+
+enum {
+    OPT_SWEEP = 256,
+    OPT_ALL_ASSOC,
+    OPT_L2_REPLAY,
+    OPT_MRC,
+    OPT_SAMPLE,
+    OPT_SAVE_CHECKPOINT,
+    OPT_LOAD_CHECKPOINT,
+    OPT_CHECKPOINT_AT,
+    OPT_STATS_INTERVAL,
+    OPT_STATS_FORMAT,
+    OPT_STATS_FILE,
+    OPT_SHM,
+    OPT_WRITE_BUFFER,
+    OPT_TIMING,
+    OPT_MSHRS,
+    OPT_DRAM,
+    OPT_PREFETCH_L1,
+    OPT_PREFETCH_L2,
+    OPT_HIERARCHY,
+    OPT_MULTICORE,
+    OPT_EPOCH,
+    OPT_PROFILE = 'T',
+    OPT_JOBS = 'j',
+};
+
+static const struct option LONG_OPTIONS[] = {
+    {"sweep", required_argument, NULL, OPT_SWEEP},
+    {"all-assoc", required_argument, NULL, OPT_ALL_ASSOC},
+    {"l2-replay", required_argument, NULL, OPT_L2_REPLAY},
+    {"profile", no_argument, NULL, OPT_PROFILE},
+    {"jobs", required_argument, NULL, OPT_JOBS},
+    {"mrc", required_argument, NULL, OPT_MRC},
+    {"sample", required_argument, NULL, OPT_SAMPLE},
+    {"save-checkpoint", required_argument, NULL, OPT_SAVE_CHECKPOINT},
+    {"load-checkpoint", required_argument, NULL, OPT_LOAD_CHECKPOINT},
+    {"checkpoint-at", required_argument, NULL, OPT_CHECKPOINT_AT},
+    {"stats-interval", required_argument, NULL, OPT_STATS_INTERVAL},
+    {"stats-format", required_argument, NULL, OPT_STATS_FORMAT},
+    {"stats-file", required_argument, NULL, OPT_STATS_FILE},
+    {"shm", required_argument, NULL, OPT_SHM},
+    {"write-buffer", required_argument, NULL, OPT_WRITE_BUFFER},
+    {"timing", optional_argument, NULL, OPT_TIMING},
+    {"mshrs", required_argument, NULL, OPT_MSHRS},
+    {"dram", required_argument, NULL, OPT_DRAM},
+    {"prefetch-l1", required_argument, NULL, OPT_PREFETCH_L1},
+    {"prefetch-l2", required_argument, NULL, OPT_PREFETCH_L2},
+    {"hierarchy", required_argument, NULL, OPT_HIERARCHY},
+    {"multicore", no_argument, NULL, OPT_MULTICORE},
+    {"epoch", required_argument, NULL, OPT_EPOCH},
+    {NULL, 0, NULL, 0},
+};
 
 int main(int argc, char **argv) {
     sim_config_t config = DEFAULT_SIM_CONFIG;
+    const char *sweep_path = NULL;
+    const char *replay_path = NULL;
+    const char *all_assoc_range = NULL;
+    const char *mrc_range = NULL;
+    const char *hierarchy_path = NULL;
+    bool multicore = false;
+    uint64_t epoch = UINT64_MAX;
+    bool profile = false;
+    sampling_t sampling;
+    bool sampled = false;
+    const char *save_path = NULL;
+    const char *load_path = NULL;
+    uint64_t checkpoint_at = UINT64_MAX;
+    uint64_t stats_interval = 0;
+    stats_format_t stats_format = STATS_FORMAT_JSON;
+    const char *stats_path = NULL;
+    unsigned jobs = 1;
+    const char *shm_name = NULL;
+    bool timed = false;
+    bool timing_options = false;
+    timing_config_t timing = DEFAULT_TIMING_CONFIG;
     int opt;
 
     /* Read arguments */
-    while(-1 != (opt = getopt(argc, argv, "c:b:s:v:C:S:P:DEh"))) {
+    while(-1 != (opt = getopt_long(argc, argv, "c:b:s:v:C:S:P:DELw:W:Tj:h", LONG_OPTIONS, NULL))) {
         switch(opt) {
-        case 'c':
-            config.l1_config.c = atoi(optarg);
+        case OPT_SWEEP:
+            sweep_path = optarg;
+            break;
+        case OPT_L2_REPLAY:
+            replay_path = optarg;
+            break;
+        case OPT_ALL_ASSOC:
+            all_assoc_range = optarg;
+            break;
+        case OPT_MRC:
+            mrc_range = optarg;
+            break;
+        case OPT_HIERARCHY:
+            hierarchy_path = optarg;
+            break;
+        case OPT_MULTICORE:
+            multicore = true;
+            break;
+        case OPT_EPOCH:
+            epoch = strtoull(optarg, NULL, 0);
+            break;
+        case OPT_SAMPLE:
+            if (parse_sampling(optarg, &sampling)) {
+                return 1;
+            }
+            sampled = true;
             break;
-        case 'b':
-            config.l1_config.b = atoi(optarg);
-            config.l2_config.b = config.l1_config.b;
+        case OPT_SAVE_CHECKPOINT:
+            save_path = optarg;
             break;
-        case 's':
-            config.l1_config.s = atoi(optarg);
+        case OPT_LOAD_CHECKPOINT:
+            load_path = optarg;
             break;
-        case 'v':
-            config.victim_cache_entries = atoi(optarg);
+        case OPT_CHECKPOINT_AT:
+            checkpoint_at = strtoull(optarg, NULL, 0);
+            break;
+        case OPT_STATS_INTERVAL:
+            stats_interval = strtoull(optarg, NULL, 0);
+            if (!stats_interval) {
+                printf("--stats-interval must be a positive number of records\n");
+                return 1;
+            }
+            break;
+        case OPT_STATS_FORMAT:
+            if (!strcmp(optarg, "json")) {
+                stats_format = STATS_FORMAT_JSON;
+            } else if (!strcmp(optarg, "csv")) {
+                stats_format = STATS_FORMAT_CSV;
+            } else {
+                printf("Unknown statistics format `%s'\n", optarg);
+                return 1;
+            }
             break;
-        case 'C':
-            config.l2_config.c = atoi(optarg);
+        case OPT_STATS_FILE:
+            stats_path = optarg;
             break;
-        case 'S':
-            config.l2_config.s = atoi(optarg);
+        case OPT_SHM:
+            shm_name = optarg;
             break;
-        case 'P':
-            if (parse_replace_policy(optarg, &config.l2_config.replace_policy)) {
+        case OPT_WRITE_BUFFER:
+            if (parse_write_buffer(optarg, &config.write_buffer)) {
                 return 1;
             }
             break;
-        case 'D':
-            config.l2_config.disabled = 1;
+        case OPT_TIMING:
+            if (optarg && !((timing.issue_cycles = strtod(optarg, NULL)) > 0)) {
+                printf("--timing takes a positive number of cycles between records\n");
+                return 1;
+            }
+            timed = true;
             break;
-        case 'E':
-            config.l2_config.enable_ER = 1;
+        case OPT_MSHRS:
+            if (parse_timing_pair(optarg, "--mshrs", &timing.mshrs_l1, &timing.mshrs_l2)) {
+                return 1;
+            }
+            timing_options = true;
+            break;
+        case OPT_DRAM:
+            if (parse_timing_pair(optarg, "--dram", &timing.dram_channels, &timing.dram_banks)) {
+                return 1;
+            }
+            timing_options = true;
+            break;
+        case OPT_PREFETCH_L1:
+            if (parse_prefetch(optarg, "--prefetch-l1", &config.prefetch_l1)) {
+                return 1;
+            }
+            break;
+        case OPT_PREFETCH_L2:
+            if (parse_prefetch(optarg, "--prefetch-l2", &config.prefetch_l2)) {
+                return 1;
+            }
+            break;
+        case OPT_PROFILE:
+            if (!PROFILE_ENABLED) {
+                printf("Profiling is not compiled in; rebuild with make PROFILE=1\n");
+                return 1;
+            }
+            profile = true;
+            break;
+        case OPT_JOBS:
+            jobs = strtoul(optarg, NULL, 0);
+            if (!jobs) {
+                printf("-j must be a positive number of threads\n");
+                return 1;
+            }
             break;
         case 'h':
-            /* Fall through */
-        default:
             print_help();
             return 0;
+        default:
+            if (!strchr(CONFIG_OPTSTRING, opt)) {
+                print_help();
+                return 0;
+            }
+            if (parse_config_option(opt, optarg, &config)) {
+                return 1;
+            }
+            break;
         }
     }
 
-    printf("Cache Settings\n");
-    printf("--------------\n");
-    print_cache_config(&config.l1_config, "L1");
-    printf("Victim cache entries: %" PRIu64 "\n", config.victim_cache_entries);
-    print_cache_config(&config.l2_config, "L2");
-    printf("\n");
+    if (epoch != UINT64_MAX && !multicore) {
+        printf("--epoch only applies with --multicore\n");
+        return 1;
+    }
+    if (multicore && (sweep_path || replay_path || all_assoc_range || mrc_range || hierarchy_path)) {
+        printf("--multicore cannot be combined with --sweep, --l2-replay, --all-assoc, --mrc or --hierarchy\n");
+        return 1;
+    }
+
+    /* The trace comes from a file operand, a shared-memory ring or stdin */
+    if (shm_name && optind < argc) {
+        printf("--shm takes the place of the TRACE operand\n");
+        return 1;
+    }
+    if (shm_name && sweep_path) {
+        printf("--sweep needs a trace it can load, not --shm\n");
+        return 1;
+    }
+    auto open_trace = [&](trace_file_t *trace) {
+        return shm_name ? trace_open_shm(trace, shm_name) : trace_open(trace, optind < argc ? argv[optind] : NULL);
+    };
+
+    if (sweep_path) {
+        trace_file_t trace;
+        if (open_trace(&trace) || trace_load(&trace)) {
+            return 1;
+        }
+        int ret = run_sweep(sweep_path, &trace);
+        trace_close(&trace);
+        return ret;
+    }
+
+    if (replay_path) {
+        trace_file_t trace;
+        if (open_trace(&trace)) {
+            return 1;
+        }
+        int ret = run_l2_replay(replay_path, &trace);
+        trace_close(&trace);
+        return ret;
+    }
+
+    if (all_assoc_range) {
+        trace_file_t trace;
+        if (open_trace(&trace)) {
+            return 1;
+        }
+        int ret = run_all_assoc(all_assoc_range, config.l1_config.b, &trace);
+        trace_close(&trace);
+        return ret;
+    }
+
+    if (mrc_range) {
+        trace_file_t trace;
+        if (open_trace(&trace)) {
+            return 1;
+        }
+        int ret = run_mrc(mrc_range, config.l1_config.b, &trace);
+        trace_close(&trace);
+        return ret;
+    }
+
+    if (hierarchy_path) {
+        trace_file_t trace;
+        if (open_trace(&trace)) {
+            return 1;
+        }
+        int ret = run_hierarchy(hierarchy_path, &trace);
+        trace_close(&trace);
+        return ret;
+    }
+
+    print_settings(&config);
 
     if (validate_config(&config)) {
         return 1;
     }
+    if (multicore) {
+        if (shm_name || optind >= argc) {
+            printf("--multicore needs a TRACE operand per core\n");
+            return 1;
+        }
+        if (sampled || save_path || load_path || stats_interval || profile || timed) {
+            printf("--multicore cannot be combined with --sample, checkpoints, --stats-interval, -T or --timing\n");
+            return 1;
+        }
+        return run_multicore(&config, std::vector<const char *>(argv + optind, argv + argc), jobs,
+                             epoch != UINT64_MAX ? epoch : jobs > 1 ? MULTICORE_DEFAULT_EPOCH : 0);
+    }
+    if (sampled && (save_path || load_path)) {
+        printf("--sample cannot be combined with checkpoints\n");
+        return 1;
+    }
+    if (jobs > 1 && (sampled || save_path || load_path || stats_interval || profile)) {
+        printf("-j cannot be combined with --sample, checkpoints, --stats-interval or -T\n");
+        return 1;
+    }
+    if (sampled && stats_interval) {
+        printf("--sample cannot be combined with --stats-interval\n");
+        return 1;
+    }
+    if (uses_opt(&config) && (sampled || save_path || load_path)) {
+        printf("OPT cannot be combined with --sample or checkpoints\n");
+        return 1;
+    }
+    if (uses_opt(&config) && (shm_name || optind >= argc)) {
+        printf("OPT reads the trace twice, so it needs a TRACE operand\n");
+        return 1;
+    }
+    if (timing_options && !timed) {
+        printf("--mshrs and --dram only apply with --timing\n");
+        return 1;
+    }
+    if (timed && (sampled || save_path || load_path || jobs > 1 || stats_interval || profile)) {
+        printf("--timing cannot be combined with --sample, checkpoints, -j, --stats-interval or -T\n");
+        return 1;
+    }
+    if (config.write_buffer.entries && (sampled || save_path || load_path)) {
+        printf("--write-buffer cannot be combined with --sample or checkpoints\n");
+        return 1;
+    }
+    if (prefetches(&config) && (sampled || save_path || load_path || timed)) {
+        printf("Prefetching cannot be combined with --sample, checkpoints or --timing\n");
+        return 1;
+    }
+
+    /* Open the trace; binary traces are mapped */
+    trace_file_t trace;
+    if (open_trace(&trace)) {
+        return 1;
+    }
 
     /* Setup the cache */
     sim_setup(&config);
 
+    /* OPT looks at the whole trace first, then simulates it from the start */
+    if (uses_opt(&config)) {
+        auto plan_start = std::chrono::steady_clock::now();
+        if (sim_plan_opt(&trace)) {
+            return 1;
+        }
+        trace_rewind(&trace);
+        printf("Planned OPT in %.3f ms\n\n",
+               std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - plan_start).count());
+    }
+
+    /* The timing model follows the records one at a time, in issue order */
+    if (timed) {
+        return run_timing(&config, &timing, &trace);
+    }
+
+    /* Split the sets between threads when they do not interact */
+    std::unique_ptr<ShardedSimulator> sharded;
+    if (jobs > 1) {
+        const char *why = NULL;
+        unsigned shards = ShardedSimulator::plan(config, jobs, &why);
+        if (shards > 1) {
+            printf("Simulating on %u threads, each with its own sets\n\n", shards);
+            sharded.reset(new ShardedSimulator(config, shards));
+        }
+        else {
+            printf("Simulating on one thread: %s\n\n", why);
+        }
+    }
+
     /* Setup statistics */
     sim_stats_t stats;
     memset(&stats, 0, sizeof stats);
 
+    /* The same hierarchy without prefetching, for the AAT it saves */
+    std::unique_ptr<Simulator> baseline;
+    sim_stats_t baseline_stats;
+    memset(&baseline_stats, 0, sizeof baseline_stats);
+    if (prefetches(&config)) {
+        sim_config_t baseline_config = config;
+        baseline_config.prefetch_l1 = baseline_config.prefetch_l2 = DEFAULT_SIM_CONFIG.prefetch_l1;
+        baseline.reset(new Simulator());
+        baseline->setup(baseline_config);
+        baseline->evict_srand(0);
+    }
+
     /* Begin reading the file */
-    char rw;
-    uint64_t address;
-    
     evict_srand(0);
 
-    while (!feof(stdin)) {
-        int ret = fscanf(stdin, "%c 0x%" PRIx64 "\n", &rw, &address);
-        if(ret == 2) {
-            sim_access(rw, address, &stats);
+    /* Resume from a checkpoint, skipping the records it already covers */
+    uint64_t records_done = 0;
+    if (load_path) {
+        auto load_start = std::chrono::steady_clock::now();
+        if (sim_load_checkpoint(load_path, &records_done)) {
+            return 1;
+        }
+        if (trace_skip(&trace, records_done) != records_done) {
+            printf("The trace ends before the checkpoint's offset of %" PRIu64 " records\n", records_done);
+            return 1;
         }
+        if (save_path && checkpoint_at != UINT64_MAX && checkpoint_at < records_done) {
+            printf("--checkpoint-at %" PRIu64 " comes before the loaded checkpoint's offset of %" PRIu64 " records\n",
+                   checkpoint_at, records_done);
+            return 1;
+        }
+        printf("Restored checkpoint `%s' at record %" PRIu64 " in %.3f ms\n\n", load_path, records_done,
+               std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - load_start).count());
     }
+    bool saved = false;
+    auto save = [&]() {
+        auto save_start = std::chrono::steady_clock::now();
+        if (sim_save_checkpoint(save_path, records_done)) {
+            return 1;
+        }
+        printf("Saved checkpoint `%s' at record %" PRIu64 " in %.3f ms\n\n", save_path, records_done,
+               std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - save_start).count());
+        saved = true;
+        return 0;
+    };
+    auto simulate_records = [&](const access_t *records, size_t count) {
+        if (sampled) {
+            sample_batch(&sampling, records, count, &stats);
+        }
+        else if (sharded) {
+            sharded->access_batch(records, count);
+        }
+        else {
+            sim_access_batch(records, count, &stats);
+        }
+        if (baseline) {
+            baseline->access_batch(records, count, &baseline_stats);
+        }
+        records_done += count;
+    };
 
-    sim_finish(&stats);
+    /* Interval statistics: the deltas between snapshots of stats */
+    std::unique_ptr<StatsStream> interval_stream;
+    FILE *stats_out = NULL;
+    uint64_t next_interval = UINT64_MAX;
+    sim_stats_t interval_start = stats;
+    if (stats_interval) {
+        if (!stats_path) {
+            stats_path = stats_format == STATS_FORMAT_CSV ? "stats.csv" : "stats.jsonl";
+        }
+        stats_out = fopen(stats_path, "w");
+        if (!stats_out) {
+            printf("Could not create `%s'\n", stats_path);
+            return 1;
+        }
+        printf("Writing statistics every %" PRIu64 " records to `%s'\n\n", stats_interval, stats_path);
+        interval_stream.reset(new StatsStream(stats_out, stats_format, std::thread::hardware_concurrency() > 1));
+        next_interval = (records_done / stats_interval + 1) * stats_interval;
+    }
+    auto end_interval = [&]() {
+        sim_stats_t delta = stats;
+        sim_stats_subtract(&delta, &interval_start);
+        sim_finish(&delta);
+        interval_stream->write(records_done, delta);
+        interval_start = stats;
+    };
+    auto simulate = [&](const access_t *records, size_t count) {
+        /* Split the batch wherever an interval ends */
+        while (next_interval - records_done <= count) {
+            size_t first = next_interval - records_done;
+            simulate_records(records, first);
+            end_interval();
+            next_interval += stats_interval;
+            records += first;
+            count -= first;
+        }
+        simulate_records(records, count);
+    };
+
+    /* Time spent waiting for batches and simulating them, for -T */
+    double read_ns = 0;
+    double sim_ns = 0;
+    auto start = std::chrono::steady_clock::now();
+    uint64_t start_ticks = profile_ticks();
+    {
+        /* Parse on another thread when there is a CPU to spare */
+        TracePipeline pipeline(&trace, std::thread::hardware_concurrency() > 1);
+        auto mark = start;
+        while (const access_batch_t *batch = pipeline.next()) {
+            if (profile) {
+                auto now = std::chrono::steady_clock::now();
+                read_ns += std::chrono::duration<double, std::nano>(now - mark).count();
+                mark = now;
+            }
+            const access_t *records = batch->records;
+            size_t count = batch->count;
+            if (save_path && !saved && checkpoint_at - records_done <= count) {
+                /* Split the batch at the checkpoint */
+                size_t first = checkpoint_at - records_done;
+                simulate(records, first);
+                if (save()) {
+                    return 1;
+                }
+                records += first;
+                count -= first;
+            }
+            simulate(records, count);
+            if (profile) {
+                auto now = std::chrono::steady_clock::now();
+                sim_ns += std::chrono::duration<double, std::nano>(now - mark).count();
+                mark = now;
+            }
+        }
+    }
+    double elapsed_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    double ticks_per_ns = (profile_ticks() - start_ticks) / elapsed_ns;
+    trace_close(&trace);
+    if (save_path && !saved && save()) {
+        return 1;
+    }
+    if (interval_stream) {
+        /* The last, partial interval */
+        if (stats.accesses_l1 != interval_start.accesses_l1) {
+            end_interval();
+        }
+        if (interval_stream->close() | fclose(stats_out)) {
+            printf("Could not write `%s'\n", stats_path);
+            return 1;
+        }
+    }
+
+    if (sampled && finish_sampling(&sampling, &stats)) {
+        return 1;
+    }
+    if (sharded) {
+        sharded->finish(&stats);
+    }
+    else {
+        sim_finish(&stats);
+    }
 
     print_statistics(&stats);
+    if (models_writes(&config)) {
+        print_write_traffic(&stats);
+    }
+    if (baseline) {
+        baseline->finish(&baseline_stats);
+        print_prefetching(&stats, &baseline_stats);
+    }
+    if (sampled) {
+        print_sampling(&sampling);
+    }
+    if (profile) {
+        print_profile(sim_profile(), ticks_per_ns, read_ns, sim_ns, stats.accesses_l1);
+    }
+
+    return 0;
+}
+
+static int parse_config_option(int opt, const char *arg, sim_config_t *config) {
+    switch(opt) {
+    case 'c':
+        config->l1_config.c = atoi(arg);
+        break;
+    case 'b':
+        config->l1_config.b = atoi(arg);
+        config->l2_config.b = config->l1_config.b;
+        break;
+    case 's':
+        config->l1_config.s = atoi(arg);
+        break;
+    case 'v':
+        config->victim_cache_entries = atoi(arg);
+        break;
+    case 'C':
+        config->l2_config.c = atoi(arg);
+        break;
+    case 'S':
+        config->l2_config.s = atoi(arg);
+        break;
+    case 'P':
+        return parse_replace_policy(arg, &config->l2_config.replace_policy);
+    case 'D':
+        config->l2_config.disabled = 1;
+        break;
+    case 'E':
+        config->l2_config.enable_ER = 1;
+        break;
+    case 'L':
+        config->l2_config.sparse = 1;
+        break;
+    case 'w':
+        return parse_write_strat(arg, &config->l1_config.write_strat);
+    case 'W':
+        return parse_write_strat(arg, &config->l2_config.write_strat);
+    default:
+        return 1;
+    }
+    return 0;
+}
+
+typedef struct sweep_run {
+    char line[256];
+    sim_config_t config;
+    sim_stats_t stats;
+} sweep_run_t;
+
+/*
+ * Reads a sweep grid: one configuration per line, written with the same
+ * hierarchy options as the command line (e.g. "-c 15 -s 2 -C 18 -S 4 -P LIP").
+ * Blank lines and lines starting with # are skipped.
+ */
+static int read_sweep_grid(const char *grid_path, std::vector<sweep_run_t> *runs) {
+    FILE *grid = fopen(grid_path, "r");
+    if (!grid) {
+        printf("Could not open sweep grid `%s'\n", grid_path);
+        return 1;
+    }
+
+    char line[256];
+    int line_no = 0;
+    while (fgets(line, sizeof line, grid)) {
+        line_no++;
+        line[strcspn(line, "\r\n")] = '\0';
+        char *start = line + strspn(line, " \t");
+        if (!*start || *start == '#') {
+            continue;
+        }
+
+        sweep_run_t run;
+        memset(&run, 0, sizeof run);
+        strcpy(run.line, start);
+        run.config = DEFAULT_SIM_CONFIG;
+
+        char *args[64];
+        int n_args = 0;
+        args[n_args++] = (char *)"sweep";
+        for (char *tok = strtok(start, " \t"); tok && n_args < 63; tok = strtok(NULL, " \t")) {
+            args[n_args++] = tok;
+        }
+        args[n_args] = NULL;
 
+        int opt;
+        optind = 0;
+        while(-1 != (opt = getopt(n_args, args, CONFIG_OPTSTRING))) {
+            if (opt == '?' || parse_config_option(opt, optarg, &run.config)) {
+                printf("%s:%d: bad configuration `%s'\n", grid_path, line_no, run.line);
+                fclose(grid);
+                return 1;
+            }
+        }
+        if (validate_config(&run.config)) {
+            printf("%s:%d: rejected configuration `%s'\n", grid_path, line_no, run.line);
+            fclose(grid);
+            return 1;
+        }
+        if (uses_opt(&run.config)) {
+            printf("%s:%d: OPT needs a run of its own `%s'\n", grid_path, line_no, run.line);
+            fclose(grid);
+            return 1;
+        }
+        runs->push_back(run);
+    }
+    fclose(grid);
+    return 0;
+}
+
+/* Runs worker on min(hardware threads, n_tasks) threads and waits for them */
+static void run_workers(size_t n_tasks, const std::function<void()> &worker) {
+    size_t n_threads = std::max(1u, std::thread::hardware_concurrency());
+    n_threads = std::min(n_threads, n_tasks);
+    std::vector<std::thread> pool;
+    for (size_t t = 0; t < n_threads; t++) {
+        pool.emplace_back(worker);
+    }
+    for (std::thread &thread : pool) {
+        thread.join();
+    }
+}
+
+static void print_sweep_runs(std::vector<sweep_run_t> *runs) {
+    for (sweep_run_t &run : *runs) {
+        printf("Configuration: %s\n", run.line);
+        print_settings(&run.config);
+        print_statistics(&run.stats);
+        if (models_writes(&run.config)) {
+            print_write_traffic(&run.stats);
+        }
+        printf("\n");
+    }
+}
+
+/*
+ * Simulates every configuration of a sweep grid against one loaded trace.
+ * Each configuration runs start to finish on one worker thread with its own
+ * Simulator and its own cursor over the shared trace; results are printed in
+ * grid order once all of them are done.
+ */
+static int run_sweep(const char *grid_path, trace_file_t *trace) {
+    std::vector<sweep_run_t> runs;
+    if (read_sweep_grid(grid_path, &runs)) {
+        return 1;
+    }
+
+    std::atomic<size_t> next_run(0);
+    auto worker = [&]() {
+        Simulator sim;
+        for (size_t i; (i = next_run++) < runs.size(); ) {
+            trace_file_t cursor = *trace;
+            trace_rewind(&cursor);
+            sim.setup(runs[i].config);
+            sim.evict_srand(0);
+            char rw;
+            uint64_t address;
+            while (trace_next(&cursor, &rw, &address)) {
+                sim.access(rw, address, &runs[i].stats);
+            }
+            sim.finish(&runs[i].stats);
+        }
+    };
+
+    run_workers(runs.size(), worker);
+    print_sweep_runs(&runs);
+    return 0;
+}
+
+/*
+ * Like run_sweep() for grids that only vary the L2. L1 and the victim cache
+ * are simulated once while recording the L2 reads and write-backs they
+ * produce; each configuration then replays that much shorter stream against
+ * its own L2. Every line must agree on -c, -b, -s and -v.
+ */
+static int run_l2_replay(const char *grid_path, trace_file_t *trace) {
+    std::vector<sweep_run_t> runs;
+    if (read_sweep_grid(grid_path, &runs)) {
+        return 1;
+    }
+    if (runs.empty()) {
+        return 0;
+    }
+    const sim_config_t &first = runs[0].config;
+    for (sweep_run_t &run : runs) {
+        if (run.config.l1_config.c != first.l1_config.c
+            || run.config.l1_config.b != first.l1_config.b
+            || run.config.l1_config.s != first.l1_config.s
+            || run.config.l1_config.write_strat != first.l1_config.write_strat
+            || run.config.victim_cache_entries != first.victim_cache_entries) {
+            printf("L2 replay needs the same L1 and victim cache on every line: `%s'\n", run.line);
+            return 1;
+        }
+    }
+
+    /* The L2 traffic does not depend on the L2, so record it with none */
+    sim_config_t l1_only = first;
+    l1_only.l2_config.disabled = 1;
+    trace_buffer_t stream;
+    memset(&stream, 0, sizeof stream);
+    sim_stats_t l1_stats;
+    memset(&l1_stats, 0, sizeof l1_stats);
+    Simulator recorder;
+    recorder.setup(l1_only);
+    recorder.record_l2_stream(&stream);
+    char rw;
+    uint64_t address;
+    while (trace_next(trace, &rw, &address)) {
+        recorder.access(rw, address, &l1_stats);
+    }
+    if (recorder.l2_stream_failed()) {
+        printf("Out of memory recording the L2 traffic for --l2-replay\n");
+        trace_buffer_free(&stream);
+        return 1;
+    }
+    l1_stats.read_misses_l2 = 0;
+    l1_stats.write_hits_l2 = l1_stats.write_misses_l2 = l1_stats.write_backs_l2 = 0;
+    l1_stats.writes_dram = l1_stats.write_buffer_merges = l1_stats.write_buffer_stalls = 0;
+    l1_stats.write_buffer_stall_cycles = 0;
+
+    std::atomic<size_t> next_run(0);
+    auto worker = [&]() {
+        Simulator sim;
+        for (size_t i; (i = next_run++) < runs.size(); ) {
+            trace_file_t cursor;
+            trace_buffer_reader(&stream, &cursor);
+            sim.setup(runs[i].config);
+            sim.evict_srand(0);
+            runs[i].stats = l1_stats;
+            char event;
+            uint64_t event_address;
+            while (trace_next(&cursor, &event, &event_address)) {
+                sim.access_l2(event, event_address, &runs[i].stats);
+            }
+            sim.finish(&runs[i].stats);
+        }
+    };
+    run_workers(runs.size(), worker);
+    trace_buffer_free(&stream);
+
+    print_sweep_runs(&runs);
     return 0;
 }
 
@@ -107,14 +894,121 @@ static int parse_replace_policy(const char *arg, replacement_policy_t *policy_ou
     } else if (!strcmp(arg, "random") || !strcmp(arg, "RANDOM")) {
         *policy_out = REPLACEMENT_POLICY_RANDOM;
         return 0;
+    } else if (!strcmp(arg, "plru") || !strcmp(arg, "TREE_PLRU")) {
+        *policy_out = REPLACEMENT_POLICY_TREE_PLRU;
+        return 0;
+    } else if (!strcmp(arg, "srrip") || !strcmp(arg, "SRRIP")) {
+        *policy_out = REPLACEMENT_POLICY_SRRIP;
+        return 0;
+    } else if (!strcmp(arg, "brrip") || !strcmp(arg, "BRRIP")) {
+        *policy_out = REPLACEMENT_POLICY_BRRIP;
+        return 0;
+    } else if (!strcmp(arg, "drrip") || !strcmp(arg, "DRRIP")) {
+        *policy_out = REPLACEMENT_POLICY_DRRIP;
+        return 0;
+    } else if (!strcmp(arg, "opt") || !strcmp(arg, "OPT")) {
+        *policy_out = REPLACEMENT_POLICY_OPT;
+        return 0;
     } else {
         printf("Unknown cache insertion/replacement policy `%s'\n", arg);
         return 1;
     }
 }
 
+static int parse_write_strat(const char *arg, write_strat_t *strat_out) {
+    if (!strcmp(arg, "wbwa") || !strcmp(arg, "WBWA")) {
+        *strat_out = WRITE_STRAT_WBWA;
+        return 0;
+    } else if (!strcmp(arg, "wtwna") || !strcmp(arg, "WTWNA")) {
+        *strat_out = WRITE_STRAT_WTWNA;
+        return 0;
+    } else {
+        printf("Unknown write strategy `%s'\n", arg);
+        return 1;
+    }
+}
+
+/* ENTRIES[,DRAIN_CYCLES[,nomerge]] */
+static int parse_write_buffer(const char *arg, write_buffer_config_t *buffer) {
+    char *end;
+    buffer->entries = strtoull(arg, &end, 0);
+    if (*end == ',') {
+        buffer->drain_cycles = strtod(end + 1, &end);
+        if (!strcmp(end, ",nomerge")) {
+            buffer->merge = 0;
+            end += strlen(end);
+        }
+    }
+    if (*end || !buffer->entries || buffer->drain_cycles < 0) {
+        printf("Bad --write-buffer `%s'; expected ENTRIES[,DRAIN_CYCLES[,nomerge]]\n", arg);
+        return 1;
+    }
+    return 0;
+}
+
+/* FIRST[,SECOND], both positive; SECOND keeps its value when left out */
+static int parse_timing_pair(const char *arg, const char *name, unsigned *first, unsigned *second) {
+    char *end;
+    unsigned long value = strtoul(arg, &end, 0);
+    unsigned long value2 = *second;
+    if (*end == ',') {
+        value2 = strtoul(end + 1, &end, 0);
+    }
+    if (*end || !value || !value2 || value > 65536 || value2 > 65536) {
+        printf("Bad %s `%s'; expected two counts from 1 to 65536\n", name, arg);
+        return 1;
+    }
+    *first = value;
+    *second = value2;
+    return 0;
+}
+
+static const char *prefetcher_str(prefetcher_t kind) {
+    switch (kind) {
+        case PREFETCHER_NONE: return "none";
+        case PREFETCHER_NEXT_LINE: return "next-line";
+        case PREFETCHER_STRIDE: return "stride";
+        case PREFETCHER_STREAM: return "stream";
+        default: return "Unknown prefetcher";
+    }
+}
+
+/* KIND[,DEGREE[,DISTANCE]] */
+static int parse_prefetch(const char *arg, const char *name, prefetch_config_t *prefetch) {
+    const char *comma = strchr(arg, ',');
+    size_t len = comma ? (size_t)(comma - arg) : strlen(arg);
+    int kind;
+    for (kind = PREFETCHER_NONE; kind <= PREFETCHER_STREAM; kind++) {
+        const char *str = prefetcher_str((prefetcher_t)kind);
+        if (strlen(str) == len && !strncmp(arg, str, len)) break;
+    }
+    char *end = (char *)arg + len;
+    uint64_t degree = prefetch->degree;
+    uint64_t distance = prefetch->distance;
+    if (*end == ',') {
+        degree = strtoull(end + 1, &end, 0);
+        if (*end == ',') {
+            distance = strtoull(end + 1, &end, 0);
+        }
+    }
+    if (kind > PREFETCHER_STREAM || *end || !degree || degree > PREFETCH_MAX_DEGREE || !distance
+        || distance > 1024) {
+        printf("Bad %s `%s'; expected none|next-line|stride|stream[,DEGREE[,DISTANCE]]\n", name, arg);
+        printf("with DEGREE from 1 to %" PRIu64 " and DISTANCE from 1 to 1024\n", PREFETCH_MAX_DEGREE);
+        return 1;
+    }
+    prefetch->kind = (prefetcher_t)kind;
+    prefetch->degree = degree;
+    prefetch->distance = distance;
+    return 0;
+}
+
 static void print_help(void) {
-    printf("cachesim [OPTIONS] < traces/file.trace\n");
+    printf("cachesim [OPTIONS] [TRACE] < traces/file.trace\n");
+    printf("TRACE is a text trace or a binary one made by cachesim-convert;\n");
+    printf("without it the trace is read from stdin, or with --shm from a program\n");
+    printf("  --shm NAME\tRead the trace from the shared memory ring NAME as a program\n");
+    printf("\t\twrites it, see shm_ring.hpp; waits for the program to start\n");
     printf("-h\t\tThis helpful output\n");
     printf("L1 parameters:\n");
     printf("  -c C1\t\tTotal size for L1 in bytes is 2^C1\n");
@@ -125,9 +1019,118 @@ static void print_help(void) {
     printf("L2 parameters:\n");
     printf("  -C C2\t\tTotal size in bytes for L2 is 2^C1\n");
     printf("  -S S2\t\tNumber of blocks per set for L2 is 2^S1\n");
-    printf("  -P P2\t\tInsertion policy for L2 (mip, lip, fifo or random)\n");
+    printf("  -P P2\t\tInsertion policy for L2 (mip, lip, fifo, random, plru,\n");
+    printf("\t\tsrrip, brrip, drrip or opt). opt reads the trace twice, so\n");
+    printf("\t\tit needs a TRACE operand and no sampling or checkpoints\n");
     printf("  -D   \t\tDisable L2 cache\n");
     printf("  -E   \t\tEnable Early Restart on L2 cache\n");
+    printf("  -L   \t\tLarge L2: allocate sets on first touch and pack the tags,\n");
+    printf("\t\tso memory follows the working set rather than C2\n");
+    printf("Writes:\n");
+    printf("  -w, -W wbwa|wtwna\n");
+    printf("\t\tWrite strategy for L1 (default wbwa) and L2 (default wtwna):\n");
+    printf("\t\twrite-back with write-allocate, or write-through with no\n");
+    printf("\t\twrite-allocate\n");
+    printf("  --write-buffer=ENTRIES[,DRAIN_CYCLES[,nomerge]]\n");
+    printf("\t\tQueue DRAM writes in a buffer of ENTRIES blocks, each taking\n");
+    printf("\t\tDRAIN_CYCLES to retire (default one DRAM access); writes to a\n");
+    printf("\t\tqueued block merge unless nomerge. A write that finds it full\n");
+    printf("\t\tstalls until an entry retires\n");
+    printf("Timing:\n");
+    printf("  --timing[=ISSUE_CYCLES]\n");
+    printf("\t\tAlso time the trace with non-blocking misses: records issue in\n");
+    printf("\t\torder ISSUE_CYCLES apart (default 1), or at the cycle a text\n");
+    printf("\t\trecord gives after its address (\"R 0x1f40 5120\"), and the\n");
+    printf("\t\tcore only stalls when every L1 MSHR is busy. Reports the\n");
+    printf("\t\tcycles taken, memory-level parallelism and stalls\n");
+    printf("  --mshrs=L1[,L2]\tMisses L1 and L2 keep in flight (default %u,%u)\n",
+           DEFAULT_TIMING_CONFIG.mshrs_l1, DEFAULT_TIMING_CONFIG.mshrs_l2);
+    printf("  --dram=CHANNELS[,BANKS]\n");
+    printf("\t\tDRAM channels and banks per channel (default %u,%u); blocks\n",
+           DEFAULT_TIMING_CONFIG.dram_channels, DEFAULT_TIMING_CONFIG.dram_banks);
+    printf("\t\tinterleave across them\n");
+    printf("Prefetching:\n");
+    printf("  --prefetch-l1=KIND[,DEGREE[,DISTANCE]]\n");
+    printf("  --prefetch-l2=KIND[,DEGREE[,DISTANCE]]\n");
+    printf("\t\tPrefetch into L1 or L2 on its demand misses. KIND is none,\n");
+    printf("\t\tnext-line, stride (learned per 2^%u-byte region, the trace\n", PREFETCH_REGION_BITS);
+    printf("\t\thaving no PCs) or stream (%u stream buffers filling the cache).\n", PREFETCH_STREAMS);
+    printf("\t\tEach miss fetches DEGREE blocks (default 1) starting DISTANCE\n");
+    printf("\t\tblocks or strides ahead (default 1). Reports useful, late,\n");
+    printf("\t\tunused and polluting prefetches and the AAT without them.\n");
+    printf("\t\tNot with OPT, -L (L2), --sample, checkpoints or --timing\n");
+    printf("Sampling:\n");
+    printf("  --sample=PERIOD,WARMUP,DETAIL\n");
+    printf("\t\tOf every PERIOD records skip all but the last WARMUP + DETAIL,\n");
+    printf("\t\twarm the caches with WARMUP and measure DETAIL; statistics are\n");
+    printf("\t\textrapolated to the whole trace, with 95%% confidence intervals\n");
+    printf("Checkpoints:\n");
+    printf("  --save-checkpoint FILE\n");
+    printf("\t\tSave the cache state to FILE at the end of the trace\n");
+    printf("  --checkpoint-at N\tSave it after N records instead and carry on\n");
+    printf("  --load-checkpoint FILE\n");
+    printf("\t\tStart from the cache state in FILE, skipping the records it\n");
+    printf("\t\tcovers; statistics count only the rest. The geometry must match.\n");
+    printf("Interval statistics:\n");
+    printf("  --stats-interval N\n");
+    printf("\t\tAlso write the statistics of every N records on their own to a file\n");
+    printf("  --stats-format json|csv\n");
+    printf("\t\tOne JSON object per line (default) or CSV with a header row\n");
+    printf("  --stats-file FILE\n");
+    printf("\t\tWhere to write them, stats.jsonl or stats.csv by default\n");
+    printf("Profiling:\n");
+    printf("  -T, --profile\tReport time and events per simulation phase and the\n");
+    printf("\t\ttrace read time; needs a build with make PROFILE=1\n");
+    printf("Threads:\n");
+    printf("  -j, --jobs N\tSimulate on N threads, each with its own group of sets.\n");
+    printf("\t\tResults match a run on one thread; without a shared set\n");
+    printf("\t\tstructure to split, such as a victim cache (-v 0 to drop it)\n");
+    printf("\t\tor a RANDOM, BRRIP, DRRIP or OPT L2, or prefetching, the run\n");
+    printf("\t\tstays serial\n");
+    printf("Sweeps:\n");
+    printf("  --sweep GRID\tSimulate every configuration listed in GRID, one per line\n");
+    printf("\t\tusing the options above, in parallel over a single load of the trace\n");
+    printf("  --l2-replay GRID\tLike --sweep for grids that only vary the L2: L1 and\n");
+    printf("\t\tthe victim cache are simulated once and their L2 traffic replayed\n");
+    printf("  --all-assoc C_MIN:C_MAX:S_MAX\n");
+    printf("\t\tOne pass reporting the L1 for every C1 in [C_MIN, C_MAX] and\n");
+    printf("\t\tS1 in [0, S_MAX] at the block size given by -b\n");
+    printf("  --mrc C_MIN:C_MAX[:SAMPLES]\n");
+    printf("\t\tApproximate miss ratio of a fully associative LRU cache of 2^C\n");
+    printf("\t\tbytes for every C in [C_MIN, C_MAX], block size from -b, in one\n");
+    printf("\t\tpass tracking at most SAMPLES blocks (default %d)\n", MRC_DEFAULT_SAMPLES);
+    printf("Hierarchies:\n");
+    printf("  --hierarchy FILE\tSimulate the levels FILE describes instead of the\n");
+    printf("\t\thierarchy above: one [NAME] section per level, first to last,\n");
+    printf("\t\twith the keys c, b, s, policy, write (wbwa or wtwna), inclusion\n");
+    printf("\t\t(nine, inclusive or exclusive), victim (entries), hit_time and\n");
+    printf("\t\thit_time_per_s. Every level shares the first one's b\n");
+    printf("Multi-core:\n");
+    printf("  --multicore\tSimulate one core per TRACE operand (at most %u), each with\n", MULTICORE_MAX_CORES);
+    printf("\t\tthe L1 and victim cache above, sharing the L2, kept coherent by\n");
+    printf("\t\tMESI with a directory. Records interleave by the cycle a text\n");
+    printf("\t\trecord gives after its address, else round-robin. Reports each\n");
+    printf("\t\tcore's invalidations, coherence write-backs and L2 blocks other\n");
+    printf("\t\tcores evicted. The L1 must be wbwa; not with -D, -E, -L, OPT,\n");
+    printf("\t\t--write-buffer or prefetching\n");
+    printf("  --epoch N\tRun the cores' L1s N records at a time, on the threads -j\n");
+    printf("\t\tgives (default %" PRIu64 " with -j, else 0), resolving coherence\n", MULTICORE_DEFAULT_EPOCH);
+    printf("\t\tat the end of each epoch; 0 resolves it after every record\n");
+}
+
+static bool uses_opt(const sim_config_t *config) {
+    return !config->l2_config.disabled && config->l2_config.replace_policy == REPLACEMENT_POLICY_OPT;
+}
+
+/* Whether to show the write settings and traffic, which the defaults leave out */
+static bool models_writes(const sim_config_t *config) {
+    return config->l1_config.write_strat != DEFAULT_SIM_CONFIG.l1_config.write_strat
+        || config->l2_config.write_strat != DEFAULT_SIM_CONFIG.l2_config.write_strat
+        || config->write_buffer.entries;
+}
+
+static bool prefetches(const sim_config_t *config) {
+    return config->prefetch_l1.kind != PREFETCHER_NONE || config->prefetch_l2.kind != PREFETCHER_NONE;
 }
 
 static int validate_config(sim_config_t *config) {
@@ -146,8 +1149,51 @@ static int validate_config(sim_config_t *config) {
         return 1;
     }
 
-    if (config->victim_cache_entries > 2) {
-        printf("Invalid configuration! Victim Cache entries must be 0, 1, or 2\n");
+    if (config->l1_config.c < config->l1_config.b + config->l1_config.s
+        || (!config->l2_config.disabled && config->l2_config.c < config->l2_config.b + config->l2_config.s)) {
+        printf("Invalid configuration! A cache must hold at least one set: C >= B + S\n");
+        return 1;
+    }
+
+    if (config->l1_config.c > 32 || (!config->l2_config.disabled && config->l2_config.c > 63)) {
+        printf("Invalid configuration! Caches must be at most 2^32 bytes for L1 and 2^63 bytes for L2\n");
+        return 1;
+    }
+
+    /* Every set of a flat L2 is allocated up front, about 11 bytes a block */
+    if (!config->l2_config.disabled && !config->l2_config.sparse
+        && config->l2_config.c - config->l2_config.b > 32) {
+        printf("Invalid configuration! L2 caches of more than 2^32 blocks need -L\n");
+        return 1;
+    }
+
+    if (config->l1_config.s > 16 || config->l2_config.s > 16) {
+        printf("Invalid configuration! Associativity must be at most 2^16 blocks per set\n");
+        return 1;
+    }
+
+    if (config->victim_cache_entries > 65536) {
+        printf("Invalid configuration! Victim Cache entries must be at most 65536\n");
+        return 1;
+    }
+
+    /* OPT plans on the L2 reads alone, which a write-allocate L2 would not follow */
+    if (uses_opt(config) && config->l2_config.write_strat == WRITE_STRAT_WBWA) {
+        printf("Invalid configuration! OPT needs a write-through L2 (-W wtwna)\n");
+        return 1;
+    }
+
+    /* OPT plans on the demand reads alone; sparse sets carry no prefetched bit */
+    if (uses_opt(config) && prefetches(config)) {
+        printf("Invalid configuration! OPT cannot be combined with prefetching\n");
+        return 1;
+    }
+    if (!config->l2_config.disabled && config->l2_config.sparse && config->prefetch_l2.kind != PREFETCHER_NONE) {
+        printf("Invalid configuration! L2 prefetching needs a flat L2, not -L\n");
+        return 1;
+    }
+    if (config->l2_config.disabled && config->prefetch_l2.kind != PREFETCHER_NONE) {
+        printf("Invalid configuration! L2 prefetching needs an L2\n");
         return 1;
     }
 
@@ -160,10 +1206,523 @@ static const char *replace_policy_str(replacement_policy_t policy) {
         case REPLACEMENT_POLICY_LIP: return "LIP";
         case REPLACEMENT_POLICY_FIFO: return "FIFO";
         case REPLACEMENT_POLICY_RANDOM: return "RANDOM";
+        case REPLACEMENT_POLICY_TREE_PLRU: return "TREE_PLRU";
+        case REPLACEMENT_POLICY_SRRIP: return "SRRIP";
+        case REPLACEMENT_POLICY_BRRIP: return "BRRIP";
+        case REPLACEMENT_POLICY_DRRIP: return "DRRIP";
+        case REPLACEMENT_POLICY_OPT: return "OPT";
         default: return "Unknown policy";
     }
 }
 
+static const char *write_strat_str(write_strat_t strat) {
+    return strat == WRITE_STRAT_WBWA ? "WBWA" : "WTWNA";
+}
+
+/*
+ * One pass over the trace reporting the L1 of every size and associativity
+ * in range, "C_MIN:C_MAX:S_MAX", at block size 2^b.
+ */
+static int run_all_assoc(const char *range, uint64_t b, trace_file_t *trace) {
+    unsigned c_min, c_max, s_max;
+    AllAssocSimulator sim;
+    if (sscanf(range, "%u:%u:%u", &c_min, &c_max, &s_max) != 3
+        || b > 7 || b < 4 || sim.setup(b, c_min, c_max, s_max)) {
+        printf("Invalid all-associativity range `%s' for B = %" PRIu64 "\n", range, b);
+        return 1;
+    }
+
+    char rw;
+    uint64_t address;
+    while (trace_next(trace, &rw, &address)) {
+        sim.access(address);
+    }
+    std::vector<all_assoc_result_t> results;
+    sim.finish(&results);
+
+    printf("All-associativity L1 simulation, B = %" PRIu64 "\n", b);
+    printf("AAT assumes no victim cache and L2 disabled (-v 0 -D)\n");
+    printf("--------------\n");
+    printf("C1\tS1\tHits\tMisses\tHit ratio\tMiss ratio\tAAT\n");
+    for (all_assoc_result_t &result : results) {
+        printf("%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\t%.3f\t%.3f\t%.3f\n",
+               result.c, result.s, result.hits, result.misses,
+               result.hit_ratio, result.miss_ratio, result.avg_access_time);
+    }
+    return 0;
+}
+
+/*
+ * One pass over the trace estimating the miss-ratio curve, "C_MIN:C_MAX" or
+ * "C_MIN:C_MAX:SAMPLES", at block size 2^b.
+ */
+static int run_mrc(const char *range, uint64_t b, trace_file_t *trace) {
+    unsigned c_min, c_max, samples = MRC_DEFAULT_SAMPLES;
+    int fields = sscanf(range, "%u:%u:%u", &c_min, &c_max, &samples);
+    if (fields < 2 || c_min > c_max || c_max > 64 || c_max < b || !samples || b > 7 || b < 4) {
+        printf("Invalid miss-ratio curve range `%s' for B = %" PRIu64 "\n", range, b);
+        return 1;
+    }
+
+    MrcSampler sampler;
+    sampler.setup(b, samples);
+    char rw;
+    uint64_t address;
+    while (trace_next(trace, &rw, &address)) {
+        sampler.access(address);
+    }
+    std::vector<mrc_point_t> points;
+    sampler.finish(c_min, c_max, &points);
+
+    printf("Approximate miss-ratio curve, fully associative LRU, B = %" PRIu64 "\n", b);
+    printf("References: %" PRIu64 ", final sampling rate: %.6f\n", sampler.references(), sampler.sampling_rate());
+    printf("--------------\n");
+    printf("C\tSize (bytes)\tMiss ratio\n");
+    for (mrc_point_t &point : points) {
+        printf("%" PRIu64 "\t%.0f\t%.4f\n", point.c, ldexp(1.0, point.c), point.miss_ratio);
+    }
+    return 0;
+}
+
+static const char *inclusion_str(inclusion_t inclusion) {
+    switch (inclusion) {
+        case INCLUSION_NINE: return "NINE";
+        case INCLUSION_INCLUSIVE: return "inclusive";
+        case INCLUSION_EXCLUSIVE: return "exclusive";
+        default: return "Unknown inclusion";
+    }
+}
+
+/* One "key = value" line of a level's section */
+static int parse_level_key(const char *key, const char *value, level_config_t *level) {
+    char *end;
+    if (!strcmp(key, "policy")) {
+        return parse_replace_policy(value, &level->replace_policy);
+    }
+    if (!strcmp(key, "write")) {
+        return parse_write_strat(value, &level->write_strat);
+    }
+    if (!strcmp(key, "inclusion")) {
+        if (!strcmp(value, "nine") || !strcmp(value, "NINE")) {
+            level->inclusion = INCLUSION_NINE;
+        } else if (!strcmp(value, "inclusive")) {
+            level->inclusion = INCLUSION_INCLUSIVE;
+        } else if (!strcmp(value, "exclusive")) {
+            level->inclusion = INCLUSION_EXCLUSIVE;
+        } else {
+            printf("Unknown inclusion `%s'\n", value);
+            return 1;
+        }
+        return 0;
+    }
+    if (!strcmp(key, "hit_time") || !strcmp(key, "hit_time_per_s")) {
+        double time = strtod(value, &end);
+        if (*end || !(time >= 0)) {
+            printf("Bad %s `%s'\n", key, value);
+            return 1;
+        }
+        *(!strcmp(key, "hit_time") ? &level->hit_time_const : &level->hit_time_per_s) = time;
+        return 0;
+    }
+    uint64_t *field = !strcmp(key, "c") ? &level->c : !strcmp(key, "b") ? &level->b
+                      : !strcmp(key, "s") ? &level->s : !strcmp(key, "victim") ? &level->victim_entries : NULL;
+    if (!field) {
+        printf("Unknown key `%s'\n", key);
+        return 1;
+    }
+    *field = strtoull(value, &end, 0);
+    if (*end || !*value) {
+        printf("Bad %s `%s'\n", key, value);
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ * Reads a hierarchy file, INI style: a [NAME] section per level, from the
+ * one nearest the core down, each followed by "key = value" lines. Blank
+ * lines and comments starting with # or ; are skipped. Keys left out keep
+ * the defaults of L1 (-c/-b/-s/-w) for the first level and of L2
+ * (-C/-S/-P/-W) for the rest, with their hit times; victim buffers default
+ * to none and inclusion to NINE.
+ *
+ *   [L1]
+ *   c = 15
+ *   s = 3
+ *   victim = 4
+ *   [LLC]
+ *   c = 21
+ *   s = 4
+ *   policy = srrip
+ *   write = wbwa
+ *   inclusion = exclusive
+ *   hit_time = 30
+ */
+static int read_hierarchy(const char *path, hierarchy_config_t *config) {
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        printf("Could not open hierarchy file `%s'\n", path);
+        return 1;
+    }
+
+    memset(config, 0, sizeof *config);
+    char line[256];
+    int line_no = 0;
+    level_config_t *level = NULL;
+    while (fgets(line, sizeof line, file)) {
+        line_no++;
+        line[strcspn(line, "#;\r\n")] = '\0';
+        char *start = line + strspn(line, " \t");
+        char *end = start + strlen(start);
+        while (end > start && (end[-1] == ' ' || end[-1] == '\t')) *--end = '\0';
+        if (!*start) {
+            continue;
+        }
+
+        if (*start == '[') {
+            if (end[-1] != ']' || end - start - 2 <= 0 || end - start - 2 >= (long)sizeof level->name) {
+                printf("%s:%d: bad section `%s'\n", path, line_no, start);
+                fclose(file);
+                return 1;
+            }
+            if (config->n_levels == HIERARCHY_MAX_LEVELS) {
+                printf("%s:%d: at most %d levels\n", path, line_no, HIERARCHY_MAX_LEVELS);
+                fclose(file);
+                return 1;
+            }
+            bool first = config->n_levels == 0;
+            level = &config->levels[config->n_levels++];
+            const cache_config_t &defaults = first ? DEFAULT_SIM_CONFIG.l1_config : DEFAULT_SIM_CONFIG.l2_config;
+            level->c = defaults.c;
+            level->b = defaults.b;
+            level->s = defaults.s;
+            level->replace_policy = defaults.replace_policy;
+            level->write_strat = defaults.write_strat;
+            level->inclusion = INCLUSION_NINE;
+            level->victim_entries = 0;
+            level->hit_time_const = first ? L1_HIT_TIME_CONST : L2_HIT_TIME_CONST;
+            level->hit_time_per_s = first ? L1_HIT_TIME_PER_S : L2_HIT_TIME_PER_S;
+            memcpy(level->name, start + 1, end - start - 2);
+            continue;
+        }
+
+        char *equals = strchr(start, '=');
+        if (!level || !equals) {
+            printf("%s:%d: expected [NAME] or key = value, not `%s'\n", path, line_no, start);
+            fclose(file);
+            return 1;
+        }
+        char *key_end = equals;
+        while (key_end > start && (key_end[-1] == ' ' || key_end[-1] == '\t')) key_end--;
+        *key_end = '\0';
+        char *value = equals + 1 + strspn(equals + 1, " \t");
+        if (parse_level_key(start, value, level)) {
+            printf("%s:%d: in level %s\n", path, line_no, level->name);
+            fclose(file);
+            return 1;
+        }
+    }
+    fclose(file);
+
+    if (!config->n_levels) {
+        printf("%s: no levels\n", path);
+        return 1;
+    }
+    for (int i = 0; i < config->n_levels; i++) {
+        level = &config->levels[i];
+        const char *why = NULL;
+        if (level->b != config->levels[0].b) {
+            why = "every level must have the first one's block size";
+        } else if (level->b > 7 || level->b < 4) {
+            why = "the block size must be reasonable: 4 <= B <= 7";
+        } else if (level->s > 16) {
+            why = "associativity must be at most 2^16 blocks per set";
+        } else if (level->c < level->b + level->s) {
+            why = "a cache must hold at least one set: C >= B + S";
+        } else if (level->c - level->b > 32) {
+            why = "a level must be at most 2^32 blocks";
+        } else if (level->victim_entries > 65536) {
+            why = "victim buffers must be at most 65536 entries";
+        } else if (level->replace_policy == REPLACEMENT_POLICY_OPT) {
+            why = "OPT needs the hard-wired hierarchy";
+        } else if (i == 0 && level->inclusion != INCLUSION_NINE) {
+            why = "the first level has no levels above to include or exclude";
+        }
+        if (why) {
+            printf("Invalid configuration! Level %s: %s\n", level->name, why);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * --hierarchy: the levels of a hierarchy file on the generic level engine,
+ * see hierarchy.hpp
+ */
+static int run_hierarchy(const char *path, trace_file_t *trace) {
+    hierarchy_config_t config;
+    if (read_hierarchy(path, &config)) {
+        return 1;
+    }
+
+    printf("Hierarchy Settings\n");
+    printf("------------------\n");
+    for (int i = 0; i < config.n_levels; i++) {
+        const level_config_t &level = config.levels[i];
+        printf("%s (C,B,S): (%" PRIu64 ",%" PRIu64 ",%" PRIu64 "). Replace policy: %s. Writes: %s. Inclusion: %s. "
+               "Victim buffer: %" PRIu64 ". Hit time: %.3f\n",
+               level.name, level.c, level.b, level.s, replace_policy_str(level.replace_policy),
+               write_strat_str(level.write_strat), inclusion_str(level.inclusion), level.victim_entries,
+               level.hit_time_const + level.hit_time_per_s * level.s);
+    }
+    printf("\n");
+
+    HierarchySimulator sim;
+    sim.setup(config);
+    {
+        TracePipeline pipeline(trace, std::thread::hardware_concurrency() > 1);
+        while (const access_batch_t *batch = pipeline.next()) {
+            sim.access_batch(batch->records, batch->count);
+        }
+    }
+    hierarchy_stats_t stats;
+    sim.finish(&stats);
+
+    printf("Hierarchy Statistics\n");
+    printf("--------------------\n");
+    printf("Reads: %" PRIu64 "\n", stats.reads);
+    printf("Writes: %" PRIu64 "\n", stats.writes);
+    for (int i = 0; i < config.n_levels; i++) {
+        const char *name = config.levels[i].name;
+        const level_stats_t &level = stats.levels[i];
+        printf("\n");
+        printf("%s accesses: %" PRIu64 "\n", name, level.accesses);
+        printf("%s hits: %" PRIu64 "\n", name, level.hits);
+        if (config.levels[i].victim_entries) {
+            printf("%s victim buffer hits: %" PRIu64 "\n", name, level.victim_hits);
+        }
+        printf("%s misses: %" PRIu64 "\n", name, level.misses);
+        if (i == 0 && config.levels[i].write_strat == WRITE_STRAT_WTWNA) {
+            printf("%s write misses passed down without allocating: %" PRIu64 "\n", name, level.posted_write_misses);
+        }
+        printf("%s miss ratio: %.3f\n", name, level.miss_ratio);
+        if (i > 0) {
+            printf("%s writes from above: %" PRIu64 " (%" PRIu64 " hits, %" PRIu64 " misses)\n", name,
+                   level.writes, level.write_hits, level.write_misses);
+        }
+        printf("%s write-backs: %" PRIu64 "\n", name, level.write_backs);
+        if (config.levels[i].inclusion == INCLUSION_INCLUSIVE) {
+            printf("%s back-invalidations: %" PRIu64 "\n", name, level.back_invalidations);
+        }
+        printf("%s average access time (AAT): %.3f\n", name, level.avg_access_time);
+    }
+    printf("\n");
+    printf("DRAM reads: %" PRIu64 "\n", stats.dram_reads);
+    printf("DRAM writes: %" PRIu64 "\n", stats.dram_writes);
+    printf("DRAM access time: %.3f\n", stats.dram_time);
+    return 0;
+}
+
+/*
+ * --multicore: one core per trace, private L1s and victim caches in front of
+ * a shared, coherent L2, see multicore.hpp
+ */
+static int run_multicore(sim_config_t *config, const std::vector<const char *> &paths, unsigned jobs, uint64_t epoch) {
+    const char *why = NULL;
+    if (paths.size() > MULTICORE_MAX_CORES) {
+        printf("--multicore simulates at most %u cores\n", MULTICORE_MAX_CORES);
+        return 1;
+    }
+    if (config->l2_config.disabled) {
+        why = "a shared L2, not -D";
+    } else if (config->l2_config.enable_ER) {
+        why = "no early restart (-E)";
+    } else if (config->l2_config.sparse) {
+        why = "a flat L2, not -L";
+    } else if (uses_opt(config)) {
+        why = "an L2 policy other than OPT";
+    } else if (config->l1_config.write_strat != WRITE_STRAT_WBWA) {
+        why = "a write-back L1 (-w wbwa)";
+    } else if (config->write_buffer.entries) {
+        why = "no --write-buffer";
+    } else if (prefetches(config)) {
+        why = "no prefetching";
+    }
+    if (why) {
+        printf("--multicore needs %s\n", why);
+        return 1;
+    }
+
+    MulticoreSimulator sim;
+    if (sim.setup(*config, paths, epoch, jobs)) {
+        return 1;
+    }
+    if (epoch) {
+        printf("Simulating %zu cores on %u threads, resolving coherence every %" PRIu64 " records\n\n",
+               paths.size(), std::max(1u, std::min<unsigned>(jobs, paths.size())), epoch);
+    }
+    sim.run();
+    std::vector<core_stats_t> cores;
+    multicore_stats_t stats;
+    sim.finish(&cores, &stats);
+
+    printf("Multi-core Statistics\n");
+    printf("---------------------\n");
+    for (size_t i = 0; i < cores.size(); i++) {
+        const core_stats_t &core = cores[i];
+        printf("Core %zu (%s)\n", i, paths[i]);
+        printf("  Reads: %" PRIu64 "\n", core.reads);
+        printf("  Writes: %" PRIu64 "\n", core.writes);
+        printf("  L1 hits: %" PRIu64 "\n", core.hits_l1);
+        printf("  Victim cache hits: %" PRIu64 "\n", core.hits_victim_cache);
+        printf("  Misses: %" PRIu64 "\n", core.misses);
+        printf("  Miss ratio: %.3f\n", core.miss_ratio);
+        printf("  Upgrades: %" PRIu64 "\n", core.upgrades);
+        printf("  Invalidations sent: %" PRIu64 "\n", core.invalidations_sent);
+        printf("  Invalidations received: %" PRIu64 "\n", core.invalidations_received);
+        printf("  Downgrades received: %" PRIu64 "\n", core.downgrades_received);
+        printf("  Write-backs: %" PRIu64 "\n", core.write_backs);
+        printf("  Coherence write-backs: %" PRIu64 "\n", core.coherence_write_backs);
+        printf("  L2 reads: %" PRIu64 "\n", core.reads_l2);
+        printf("  L2 read misses: %" PRIu64 "\n", core.read_misses_l2);
+        printf("  L2 blocks evicted by other cores: %" PRIu64 "\n", core.l2_evictions_by_others);
+        printf("  Average access time (AAT): %.3f\n", core.avg_access_time);
+    }
+    printf("Shared L2\n");
+    printf("  Reads: %" PRIu64 "\n", stats.reads_l2);
+    printf("  Read hits: %" PRIu64 "\n", stats.read_hits_l2);
+    printf("  Read misses: %" PRIu64 "\n", stats.read_misses_l2);
+    printf("  Read miss ratio: %.3f\n", stats.read_miss_ratio_l2);
+    printf("  Writes: %" PRIu64 "\n", stats.writes_l2);
+    printf("  Evictions across cores: %" PRIu64 "\n", stats.cross_core_evictions);
+    printf("  Average access time (AAT): %.3f\n", stats.avg_access_time_l2);
+    printf("DRAM reads: %" PRIu64 "\n", stats.dram_reads);
+    printf("DRAM writes: %" PRIu64 "\n", stats.dram_writes);
+    if (epoch) {
+        printf("Epochs: %" PRIu64 "\n", stats.epochs);
+    }
+    printf("Average access time over all cores (AAT): %.3f\n", stats.avg_access_time);
+    return 0;
+}
+
+static int parse_sampling(const char *arg, sampling_t *sampling) {
+    memset(sampling, 0, sizeof *sampling);
+    if (sscanf(arg, "%" SCNu64 ",%" SCNu64 ",%" SCNu64, &sampling->period, &sampling->warmup, &sampling->detail) != 3
+        || !sampling->detail || sampling->warmup + sampling->detail > sampling->period) {
+        printf("Invalid sampling `%s': need PERIOD,WARMUP,DETAIL with DETAIL > 0 and WARMUP + DETAIL <= PERIOD\n", arg);
+        return 1;
+    }
+    return 0;
+}
+
+static void running_stat_add(running_stat_t *stat, double x) {
+    stat->n++;
+    double delta = x - stat->mean;
+    stat->mean += delta / stat->n;
+    stat->m2 += delta * (x - stat->mean);
+}
+
+/* Half-width of the normal-approximation 95% confidence interval of the mean */
+static double running_stat_ci95(const running_stat_t *stat) {
+    if (stat->n < 2) {
+        return NAN;
+    }
+    return 1.96 * sqrt(stat->m2 / (stat->n - 1) / stat->n);
+}
+
+/* Folds a finished measurement window into the totals and the per-window metrics */
+static void close_window(sampling_t *sampling, sim_stats_t *stats) {
+    sim_stats_t *window = &sampling->window;
+    sim_stats_add(stats, window);
+
+    sim_finish(window);
+    running_stat_add(&sampling->l1_miss_ratio, window->miss_ratio_l1);
+    if (window->reads_l2) {
+        running_stat_add(&sampling->l2_miss_ratio, window->read_miss_ratio_l2);
+    }
+    running_stat_add(&sampling->aat, window->avg_access_time_l1);
+    memset(window, 0, sizeof *window);
+}
+
+static void sample_batch(sampling_t *sampling, const access_t *records, size_t count, sim_stats_t *stats) {
+    uint64_t skip_end = sampling->period - sampling->warmup - sampling->detail;
+    uint64_t warm_end = sampling->period - sampling->detail;
+    size_t i = 0;
+    while (i < count) {
+        /* Handle the records up to the next phase change in one call */
+        uint64_t pos = sampling->position % sampling->period;
+        uint64_t phase_end = pos < skip_end ? skip_end : pos < warm_end ? warm_end : sampling->period;
+        size_t n = std::min<uint64_t>(count - i, phase_end - pos);
+        if (pos >= warm_end) {
+            sim_access_batch(records + i, n, &sampling->window);
+            sampling->measured += n;
+            if (pos + n == sampling->period) {
+                close_window(sampling, stats);
+            }
+        }
+        else if (pos >= skip_end) {
+            sim_warm_batch(records + i, n);
+        }
+        sampling->position += n;
+        i += n;
+    }
+}
+
+/* Scales the measured counts up to the whole trace */
+static int finish_sampling(sampling_t *sampling, sim_stats_t *stats) {
+    if (sampling->window.accesses_l1) {
+        close_window(sampling, stats);
+    }
+    if (!sampling->measured) {
+        printf("The trace is too short to reach a measurement window\n");
+        return 1;
+    }
+    sim_stats_scale(stats, (double)sampling->position / sampling->measured);
+    return 0;
+}
+
+static void print_sampling(const sampling_t *sampling) {
+    printf("\n");
+    printf("Sampling\n");
+    printf("--------\n");
+    printf("Records: %" PRIu64 ", measured: %" PRIu64 " in %" PRIu64 " windows\n",
+           sampling->position, sampling->measured, sampling->l1_miss_ratio.n);
+    printf("Counts above are extrapolated to the whole trace\n");
+    printf("Per-window means with 95%% confidence intervals:\n");
+    printf("L1 miss ratio: %.3f +/- %.3f\n", sampling->l1_miss_ratio.mean, running_stat_ci95(&sampling->l1_miss_ratio));
+    printf("L2 read miss ratio: %.3f +/- %.3f\n", sampling->l2_miss_ratio.mean, running_stat_ci95(&sampling->l2_miss_ratio));
+    printf("L1 average access time (AAT): %.3f +/- %.3f\n", sampling->aat.mean, running_stat_ci95(&sampling->aat));
+}
+
+static void print_settings(sim_config_t *config) {
+    printf("Cache Settings\n");
+    printf("--------------\n");
+    print_cache_config(&config->l1_config, "L1");
+    printf("Victim cache entries: %" PRIu64 "\n", config->victim_cache_entries);
+    print_cache_config(&config->l2_config, "L2");
+    if (models_writes(config)) {
+        printf("Writes: L1 %s, L2 %s. ", write_strat_str(config->l1_config.write_strat),
+               write_strat_str(config->l2_config.write_strat));
+        if (!config->write_buffer.entries) {
+            printf("No write buffer\n");
+        } else if (config->write_buffer.drain_cycles > 0) {
+            printf("Write buffer: %" PRIu64 " entries, %.1f cycles each%s\n", config->write_buffer.entries,
+                   config->write_buffer.drain_cycles, config->write_buffer.merge ? ", merging" : "");
+        } else {
+            printf("Write buffer: %" PRIu64 " entries, one DRAM access each%s\n", config->write_buffer.entries,
+                   config->write_buffer.merge ? ", merging" : "");
+        }
+    }
+    if (prefetches(config)) {
+        printf("Prefetch: L1 %s, degree %" PRIu64 ", distance %" PRIu64 ". L2 %s, degree %" PRIu64
+               ", distance %" PRIu64 "\n",
+               prefetcher_str(config->prefetch_l1.kind), config->prefetch_l1.degree, config->prefetch_l1.distance,
+               prefetcher_str(config->prefetch_l2.kind), config->prefetch_l2.degree, config->prefetch_l2.distance);
+    }
+    printf("\n");
+}
+
 static void print_cache_config(cache_config_t *cache_config, const char *cache_name) {
     printf("%s ", cache_name);
     bool is_L2 = false;
@@ -181,10 +1740,11 @@ static void print_cache_config(cache_config_t *cache_config, const char *cache_n
         }
         else
         {
-            printf("(C,B,S): (%" PRIu64 ",%" PRIu64 ",%" PRIu64 "). Replace policy: %s. Early Restart: %s\n",
+            printf("(C,B,S): (%" PRIu64 ",%" PRIu64 ",%" PRIu64 "). Replace policy: %s. Early Restart: %s%s\n",
                 cache_config->c, cache_config->b, cache_config->s,
                 replace_policy_str(cache_config->replace_policy),
-                cache_config->enable_ER? "Enabled": "Disabled");
+                cache_config->enable_ER? "Enabled": "Disabled",
+                cache_config->sparse? ". Sparse": "");
         }        
     }
 }
@@ -216,3 +1776,115 @@ static void print_statistics(sim_stats_t* stats) {
     printf("L2 read miss ratio: %.3f\n", stats->read_miss_ratio_l2);
     printf("L2 average access time (AAT): %.3f\n", stats->avg_access_time_l2);
 }
+
+static void print_write_traffic(const sim_stats_t *stats) {
+    printf("\n");
+    printf("Write Traffic\n");
+    printf("-------------\n");
+    printf("L2 write hits: %" PRIu64 "\n", stats->write_hits_l2);
+    printf("L2 write misses: %" PRIu64 "\n", stats->write_misses_l2);
+    printf("Write-backs from L2: %" PRIu64 "\n", stats->write_backs_l2);
+    printf("L1 write misses passed down without allocating: %" PRIu64 "\n", stats->posted_write_misses_l1);
+    printf("DRAM writes: %" PRIu64 "\n", stats->writes_dram);
+    printf("Write buffer merges: %" PRIu64 "\n", stats->write_buffer_merges);
+    printf("Write buffer stalls: %" PRIu64 " (%.0f cycles)\n", stats->write_buffer_stalls,
+           stats->write_buffer_stall_cycles);
+    printf("DRAM write bandwidth: %.3f bytes/cycle\n", stats->dram_write_bandwidth);
+}
+
+/* Prefetches are useful when a demand access finds them, late when it does so
+ * before they would have arrived, unused when evicted untouched and polluting
+ * when a block they pushed out misses again */
+static void print_prefetching(const sim_stats_t *stats, const sim_stats_t *baseline) {
+    printf("\n");
+    printf("Prefetching\n");
+    printf("-----------\n");
+    printf("L1 prefetches: %" PRIu64 "\n", stats->prefetches_l1);
+    printf("L1 useful prefetches: %" PRIu64 " (%" PRIu64 " late)\n", stats->useful_prefetches_l1,
+           stats->late_prefetches_l1);
+    printf("L1 unused prefetches: %" PRIu64 "\n", stats->unused_prefetches_l1);
+    printf("L1 polluting prefetches: %" PRIu64 "\n", stats->polluting_prefetches_l1);
+    printf("L1 prefetch accuracy: %.3f\n", stats->prefetches_l1 ? stats->prefetch_accuracy_l1 : 0);
+    printf("L1 prefetch coverage: %.3f\n", stats->prefetches_l1 ? stats->prefetch_coverage_l1 : 0);
+    printf("L2 reads by L1 prefetches: %" PRIu64 " (%" PRIu64 " misses)\n", stats->prefetch_reads_l2,
+           stats->prefetch_read_misses_l2);
+    printf("L2 prefetches: %" PRIu64 "\n", stats->prefetches_l2);
+    printf("L2 useful prefetches: %" PRIu64 " (%" PRIu64 " late)\n", stats->useful_prefetches_l2,
+           stats->late_prefetches_l2);
+    printf("L2 unused prefetches: %" PRIu64 "\n", stats->unused_prefetches_l2);
+    printf("L2 polluting prefetches: %" PRIu64 "\n", stats->polluting_prefetches_l2);
+    printf("L2 prefetch accuracy: %.3f\n", stats->prefetches_l2 ? stats->prefetch_accuracy_l2 : 0);
+    printf("L2 prefetch coverage: %.3f\n", stats->prefetches_l2 ? stats->prefetch_coverage_l2 : 0);
+    printf("L1 AAT without prefetching: %.3f (%+.3f with)\n", baseline->avg_access_time_l1,
+           stats->avg_access_time_l1 - baseline->avg_access_time_l1);
+}
+
+/*
+ * --timing: the usual statistics, then the timing model's. Records go one at
+ * a time so text records can carry their issue cycle.
+ */
+static int run_timing(sim_config_t *config, const timing_config_t *timing, trace_file_t *trace) {
+    sim_stats_t stats;
+    memset(&stats, 0, sizeof stats);
+    evict_srand(0);
+    TimingModel model;
+    model.setup(*config, *timing);
+    char rw;
+    uint64_t address;
+    uint64_t cycle;
+    while (trace_next_timed(trace, &rw, &address, &cycle)) {
+        model.access(rw, address, cycle, &stats);
+    }
+    trace_close(trace);
+    sim_finish(&stats);
+    timing_stats_t timing_stats;
+    model.finish(&timing_stats);
+
+    print_statistics(&stats);
+    if (models_writes(config)) {
+        print_write_traffic(&stats);
+    }
+    print_timing(timing, &timing_stats);
+    return 0;
+}
+
+static void print_timing(const timing_config_t *timing, const timing_stats_t *stats) {
+    printf("\n");
+    printf("Timing\n");
+    printf("------\n");
+    printf("MSHRs: L1 %u, L2 %u. DRAM: %u channels of %u banks. Records without a cycle issue %.3g apart\n",
+           timing->mshrs_l1, timing->mshrs_l2, timing->dram_channels, timing->dram_banks, timing->issue_cycles);
+    printf("Cycles: %.0f\n", stats->cycles);
+    printf("Accesses per cycle: %.3f\n", stats->cycles > 0 ? stats->accesses / stats->cycles : 0);
+    printf("Average access latency: %.3f\n", stats->avg_latency);
+    printf("Memory-level parallelism: %.3f\n", stats->mlp);
+    printf("L1 MSHR merges: %" PRIu64 "\n", stats->merges_l1);
+    printf("L1 MSHR stalls: %" PRIu64 " (%.0f cycles)\n", stats->mshr_stalls_l1, stats->mshr_stall_cycles_l1);
+    printf("L2 MSHR merges: %" PRIu64 "\n", stats->merges_l2);
+    printf("L2 MSHR waits: %" PRIu64 " (%.0f cycles)\n", stats->mshr_waits_l2, stats->mshr_wait_cycles_l2);
+    printf("DRAM bank wait cycles: %.0f\n", stats->dram_bank_wait_cycles);
+    printf("DRAM channel wait cycles: %.0f\n", stats->dram_channel_wait_cycles);
+    printf("Write buffer stall cycles: %.0f\n", stats->write_buffer_stall_cycles);
+}
+
+static void print_profile(const sim_profile_t *profile, double ticks_per_ns,
+                          double read_ns, double sim_ns, uint64_t accesses) {
+    printf("\n");
+    printf("Profile\n");
+    printf("-------\n");
+    printf("Trace read time: %.3f ms\n", read_ns / 1e6);
+    printf("Simulation time: %.3f ms\n", sim_ns / 1e6);
+    printf("Simulation ns/access: %.2f\n", accesses ? sim_ns / accesses : 0.0);
+    printf("%-14s %12s %12s %10s %8s\n", "Phase", "Events", "Time (ms)", "ns/event", "Share");
+    double total_ticks = 0;
+    for (int phase = 0; phase < PROFILE_PHASES; phase++) {
+        total_ticks += profile->ticks[phase];
+    }
+    for (int phase = 0; phase < PROFILE_PHASES; phase++) {
+        double ns = profile->ticks[phase] / ticks_per_ns;
+        uint64_t events = profile->events[phase];
+        printf("%-14s %12" PRIu64 " %12.3f %10.2f %7.1f%%\n", PROFILE_PHASE_NAMES[phase], events,
+               ns / 1e6, events ? ns / events : 0.0,
+               total_ticks ? 100.0 * profile->ticks[phase] / total_ticks : 0.0);
+    }
+}
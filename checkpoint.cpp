@@ -0,0 +1,233 @@
+#include "simulator.hpp"
+#include <stdio.h>
+#include <string.h>
+
+// Checkpoint format
+//
+// Host byte order throughout, like the in-memory state it mirrors.
+//
+//   magic         8 bytes  "CSIMCKPT"
+//   version       uint32   CHECKPOINT_VERSION
+//   reserved      uint32   zero
+//   trace_offset  uint64   records consumed when the checkpoint was taken
+//   rng_state     uint64   RANDOM generator state
+//   drrip_psel    uint32   DRRIP policy selector
+//   brrip_count   uint32   BRRIP insertions so far
+//   geometry      11 x uint64: L1 c, b, s, victim cache entries, L2
+//                 disabled, c, b, s, sparse, policy state (0 ranks only,
+//                 1 tree-PLRU, 2 RRIP, 3 OPT), and the number of levels
+//                 that follow
+//   levels        L1, then the victim cache if it has entries, then L2 if
+//                 enabled, each as: sets, ways (uint64), then the tags,
+//                 flags, ranks, used and live arrays. A sparse L2 stores
+//                 its materialized sets instead: keys, packed, ranks and
+//                 used. L2 then has its bit-packed policy state, if any.
+//
+// Early restart and the replacement policy are not part of the geometry,
+// only the kind of state the policy keeps, so a checkpoint can seed runs
+// that differ in those: MIP, LIP, FIFO and RANDOM interchange, as do SRRIP,
+// BRRIP and DRRIP.
+
+static const char CHECKPOINT_MAGIC[8] = {'C', 'S', 'I', 'M', 'C', 'K', 'P', 'T'};
+static const uint32_t CHECKPOINT_VERSION = 3;
+
+typedef struct checkpoint_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t trace_offset;
+    uint64_t rng_state;
+    uint32_t drrip_psel;
+    uint32_t brrip_insertions;
+    uint64_t geometry[CHECKPOINT_GEOMETRY];
+} checkpoint_header_t;
+
+template <typename T>
+static bool write_array(FILE *f, const std::vector<T> &v) {
+    return fwrite(v.data(), sizeof(T), v.size(), f) == v.size();
+}
+
+template <typename T>
+static bool read_array(FILE *f, std::vector<T> &v) {
+    return fread(v.data(), sizeof(T), v.size(), f) == v.size();
+}
+
+static bool write_level(FILE *f, const CacheLevel &level) {
+    uint64_t shape[2] = {level.used.size(), (uint64_t)level.ways};
+    return fwrite(shape, sizeof shape, 1, f) == 1
+        && write_array(f, level.tags) && write_array(f, level.flags) && write_array(f, level.ranks)
+        && write_array(f, level.used) && write_array(f, level.live)
+        && write_array(f, level.policy_bits);
+}
+
+// level must already be allocated with the geometry the checkpoint claims
+static bool read_level(FILE *f, CacheLevel &level) {
+    uint64_t shape[2];
+    return fread(shape, sizeof shape, 1, f) == 1
+        && shape[0] == level.used.size() && shape[1] == (uint64_t)level.ways
+        && read_array(f, level.tags) && read_array(f, level.flags) && read_array(f, level.ranks)
+        && read_array(f, level.used) && read_array(f, level.live)
+        && read_array(f, level.policy_bits);
+}
+
+// The victim cache is stored as a CacheLevel of one set, its list order as
+// ranks
+static bool write_level(FILE *f, const VictimCache &level) {
+    uint64_t shape[2] = {1, (uint64_t)level.entries};
+    std::vector<uint16_t> ranks(level.entries);
+    uint16_t rank = 0;
+    for (int32_t e = level.front; e != -1; e = level.next[e]) {
+        ranks[e] = rank++;
+    }
+    for (int e = level.used; e < level.entries; e++) {
+        ranks[e] = rank++;
+    }
+    std::vector<uint32_t> used(1, level.used);
+    std::vector<uint32_t> live(1, level.entries);
+    return fwrite(shape, sizeof shape, 1, f) == 1
+        && write_array(f, level.blocks) && write_array(f, level.flags) && write_array(f, ranks)
+        && write_array(f, used) && write_array(f, live);
+}
+
+static bool read_level(FILE *f, VictimCache &level) {
+    uint64_t shape[2];
+    std::vector<uint64_t> blocks(level.entries);
+    std::vector<uint8_t> flags(level.entries);
+    std::vector<uint16_t> ranks(level.entries);
+    std::vector<uint32_t> used(1), live(1);
+    if (fread(shape, sizeof shape, 1, f) != 1 || shape[0] != 1 || shape[1] != (uint64_t)level.entries
+        || !read_array(f, blocks) || !read_array(f, flags) || !read_array(f, ranks)
+        || !read_array(f, used) || !read_array(f, live) || used[0] > (uint32_t)level.entries) {
+        return false;
+    }
+    // Valid entries must hold the front ranks, each once
+    std::vector<int> order(used[0], -1);
+    for (uint32_t e = 0; e < used[0]; e++) {
+        if (ranks[e] >= used[0] || order[ranks[e]] != -1) return false;
+        order[ranks[e]] = e;
+    }
+    level.init(level.entries);
+    for (uint32_t e = 0; e < used[0]; e++) {
+        level.fill(e, blocks[e], flags[e] & BLOCK_DIRTY);
+    }
+    // Promoting from the back rank forward leaves the list in rank order
+    for (uint32_t rank = used[0]; rank-- > 0;) {
+        level.to_front(order[rank]);
+    }
+    return true;
+}
+
+static bool write_level(FILE *f, const SparseCacheLevel &level) {
+    uint64_t shape[2] = {level.sets(), (uint64_t)level.ways};
+    return fwrite(shape, sizeof shape, 1, f) == 1
+        && write_array(f, level.keys) && write_array(f, level.packed)
+        && write_array(f, level.ranks) && write_array(f, level.used)
+        && write_array(f, level.policy_bits);
+}
+
+// Replaces the level's sets with the checkpoint's
+static bool read_level(FILE *f, SparseCacheLevel &level) {
+    uint64_t shape[2];
+    if (fread(shape, sizeof shape, 1, f) != 1 || shape[0] > UINT32_MAX || shape[1] != (uint64_t)level.ways) {
+        return false;
+    }
+    level.clear();
+    for (uint64_t slot = 0; slot < shape[0]; slot++) {
+        level.materialize(0);
+    }
+    if (!read_array(f, level.keys) || !read_array(f, level.packed)
+        || !read_array(f, level.ranks) || !read_array(f, level.used)
+        || !read_array(f, level.policy_bits)) {
+        return false;
+    }
+    int bits = level.table_bits;
+    while (((uint64_t)1 << bits) < 2 * shape[0]) bits++;
+    level.rehash(bits);
+    return true;
+}
+
+void Simulator::checkpoint_geometry(uint64_t geometry[CHECKPOINT_GEOMETRY]) const {
+    geometry[0] = m_config.l1_config.c;
+    geometry[1] = m_config.l1_config.b;
+    geometry[2] = m_config.l1_config.s;
+    geometry[3] = m_config.victim_cache_entries;
+    geometry[4] = m_config.l2_config.disabled;
+    geometry[5] = m_config.l2_config.disabled ? 0 : m_config.l2_config.c;
+    geometry[6] = m_config.l2_config.disabled ? 0 : m_config.l2_config.b;
+    geometry[7] = m_config.l2_config.disabled ? 0 : m_config.l2_config.s;
+    geometry[8] = !m_config.l2_config.disabled && m_config.l2_config.sparse;
+    replacement_policy_t policy = m_config.l2_config.replace_policy;
+    geometry[9] = m_config.l2_config.disabled ? 0
+        : policy == REPLACEMENT_POLICY_TREE_PLRU ? 1 : policy_is_rrip(policy) ? 2
+        : policy == REPLACEMENT_POLICY_OPT ? 3 : 0;
+    geometry[10] = 1 + (m_config.victim_cache_entries > 0) + !m_config.l2_config.disabled;
+}
+
+int Simulator::save_checkpoint(const char *path, uint64_t trace_offset) const {
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        printf("Could not create checkpoint `%s'\n", path);
+        return 1;
+    }
+    checkpoint_header_t header;
+    memset(&header, 0, sizeof header);
+    memcpy(header.magic, CHECKPOINT_MAGIC, sizeof header.magic);
+    header.version = CHECKPOINT_VERSION;
+    header.trace_offset = trace_offset;
+    header.rng_state = *rng_state;
+    header.drrip_psel = drrip_psel;
+    header.brrip_insertions = brrip_insertions;
+    checkpoint_geometry(header.geometry);
+
+    bool ok = fwrite(&header, sizeof header, 1, f) == 1 && write_level(f, L1_cache);
+    if (ok && m_config.victim_cache_entries > 0) ok = write_level(f, victim_cache);
+    if (ok && !m_config.l2_config.disabled) {
+        ok = m_config.l2_config.sparse ? write_level(f, sparse_L2_cache) : write_level(f, L2_cache);
+    }
+    if (fclose(f) || !ok) {
+        printf("Could not write checkpoint `%s'\n", path);
+        return 1;
+    }
+    return 0;
+}
+
+int Simulator::load_checkpoint(const char *path, uint64_t *trace_offset) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        printf("Could not open checkpoint `%s'\n", path);
+        return 1;
+    }
+    checkpoint_header_t header;
+    if (fread(&header, sizeof header, 1, f) != 1
+        || memcmp(header.magic, CHECKPOINT_MAGIC, sizeof header.magic)
+        || header.version != CHECKPOINT_VERSION) {
+        printf("`%s' is not a cachesim checkpoint\n", path);
+        fclose(f);
+        return 1;
+    }
+    uint64_t geometry[CHECKPOINT_GEOMETRY];
+    checkpoint_geometry(geometry);
+    if (memcmp(geometry, header.geometry, sizeof geometry)) {
+        printf("Checkpoint `%s' was taken with a different cache geometry\n", path);
+        fclose(f);
+        return 1;
+    }
+
+    bool ok = read_level(f, L1_cache);
+    if (ok && m_config.victim_cache_entries > 0) ok = read_level(f, victim_cache);
+    if (ok && !m_config.l2_config.disabled) {
+        ok = m_config.l2_config.sparse ? read_level(f, sparse_L2_cache) : read_level(f, L2_cache);
+    }
+    fclose(f);
+    if (!ok) {
+        printf("Checkpoint `%s' is truncated or corrupt\n", path);
+        // Leave a usable cold simulator rather than a half-loaded one
+        setup(m_config);
+        return 1;
+    }
+    *rng_state = header.rng_state;
+    drrip_psel = header.drrip_psel;
+    brrip_insertions = header.brrip_insertions;
+    *trace_offset = header.trace_offset;
+    return 0;
+}
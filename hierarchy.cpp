@@ -0,0 +1,369 @@
+#include "hierarchy.hpp"
+#include <string.h>
+
+void HierarchyLevel::init(uint64_t index_bits, int n_ways, replacement_policy_t policy) {
+    this->index_bits = index_bits;
+    index_mask = ((uint64_t)1 << index_bits) - 1;
+    s = 0;
+    while ((1 << s) < n_ways) s++;
+    ways = n_ways;
+    this->policy = policy;
+    uint64_t slots = ((uint64_t)1 << index_bits) << s;
+    tags.assign(slots, 0);
+    flags.assign(slots, 0);
+    ranks.resize(slots);
+    for (uint64_t i = 0; i < slots; i++) {
+        ranks[i] = (i & (((uint64_t)1 << s) - 1)) % n_ways;
+    }
+    policy_words = policy_state_words(policy, n_ways);
+    policy_bits.assign(((uint64_t)1 << index_bits) * policy_words, 0);
+    psel = DRRIP_PSEL_INIT;
+    brrip_insertions = 0;
+    rng_state = 1;
+}
+
+int HierarchyLevel::lookup(uint64_t block) const {
+    uint64_t base = set_of(block) << s;
+    uint64_t tag = block >> index_bits;
+    for (int w = 0; w < ways; w++) {
+        if (tags[base + w] == tag && (flags[base + w] & BLOCK_VALID)) return w;
+    }
+    return -1;
+}
+
+void HierarchyLevel::touch(uint64_t set, int way) {
+    if (policy == REPLACEMENT_POLICY_MIP || policy == REPLACEMENT_POLICY_LIP) {
+        rank_to_front(&ranks[set << s], ways, way);
+    }
+    else if (policy == REPLACEMENT_POLICY_TREE_PLRU) {
+        plru_touch(&policy_bits[set * policy_words], ways, way);
+    }
+    else if (policy_is_rrip(policy)) {
+        rrpv_set(&policy_bits[set * policy_words], way, 0);
+    }
+}
+
+int HierarchyLevel::victim(uint64_t set) {
+    uint64_t base = set << s;
+    for (int w = 0; w < ways; w++) {
+        if (!(flags[base + w] & BLOCK_VALID)) return w;
+    }
+    if (policy == REPLACEMENT_POLICY_TREE_PLRU) {
+        return plru_victim(&policy_bits[set * policy_words], ways);
+    }
+    if (policy_is_rrip(policy)) {
+        return rrip_victim(&policy_bits[set * policy_words], ways);
+    }
+    if (policy == REPLACEMENT_POLICY_RANDOM) {
+        // The generator of evict_random(), one per level
+        rng_state = rng_state * 1103515243 + 12345;
+        return (unsigned int)(rng_state / 65536) % 32768 % ways;
+    }
+    return rank_find(&ranks[base], ways, ways - 1);
+}
+
+void HierarchyLevel::fill(uint64_t set, int way, uint64_t block, bool dirty) {
+    tags[(set << s) + way] = block >> index_bits;
+    flags[(set << s) + way] = BLOCK_VALID | (dirty ? BLOCK_DIRTY : 0);
+    if (policy == REPLACEMENT_POLICY_MIP || policy == REPLACEMENT_POLICY_FIFO) {
+        rank_to_front(&ranks[set << s], ways, way);
+    }
+    else if (policy == REPLACEMENT_POLICY_LIP) {
+        rank_to_back(&ranks[set << s], ways, way, ways - 1);
+    }
+    else if (policy == REPLACEMENT_POLICY_TREE_PLRU) {
+        plru_touch(&policy_bits[set * policy_words], ways, way);
+    }
+    else if (policy_is_rrip(policy)) {
+        // Same insertion as Simulator::rrip_insertion()
+        bool bimodal = policy == REPLACEMENT_POLICY_BRRIP;
+        if (policy == REPLACEMENT_POLICY_DRRIP) {
+            int leader = drrip_leader(set);
+            if (leader == 1) {
+                if (psel < DRRIP_PSEL_MAX) psel++;
+                bimodal = false;
+            }
+            else if (leader == 2) {
+                if (psel > 0) psel--;
+                bimodal = true;
+            }
+            else {
+                bimodal = psel >= DRRIP_PSEL_INIT;
+            }
+        }
+        unsigned rrpv = RRPV_LONG;
+        if (bimodal && ++brrip_insertions % BRRIP_THROTTLE != 0) rrpv = RRPV_DISTANT;
+        rrpv_set(&policy_bits[set * policy_words], way, rrpv);
+    }
+}
+
+void HierarchyLevel::invalidate(uint64_t set, int way) {
+    flags[(set << s) + way] = 0;
+    rank_to_back(&ranks[set << s], ways, way, ways - 1);
+}
+
+void HierarchySimulator::setup(const hierarchy_config_t &config) {
+    this->config = config;
+    n_levels = config.n_levels;
+    block_bits = config.levels[0].b;
+    levels.assign(n_levels, HierarchyLevel());
+    victims.assign(n_levels, HierarchyLevel());
+    for (int i = 0; i < n_levels; i++) {
+        const level_config_t &level = config.levels[i];
+        levels[i].init(level.c - level.b - level.s, 1 << level.s, level.replace_policy);
+        if (level.victim_entries > 0) {
+            victims[i].init(0, level.victim_entries, REPLACEMENT_POLICY_MIP);
+        }
+    }
+    memset(&totals, 0, sizeof totals);
+    totals.n_levels = n_levels;
+}
+
+void HierarchySimulator::access_batch(const access_t *accesses, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        access(accesses[i].rw, accesses[i].addr);
+    }
+}
+
+void HierarchySimulator::access(char rw, uint64_t addr) {
+    bool is_write = rw == WRITE;
+    if (is_write) totals.writes++;
+    else totals.reads++;
+
+    uint64_t block = addr >> block_bits;
+    HierarchyLevel &level = levels[0];
+    level_stats_t &stats = totals.levels[0];
+    stats.accesses++;
+    uint64_t set = level.set_of(block);
+    int way = level.lookup(block);
+    if (way != -1) {
+        stats.hits++;
+        level.touch(set, way);
+        if (is_write) {
+            if (config.levels[0].write_strat == WRITE_STRAT_WBWA) level.set_dirty(set, way);
+            else write(1, block);
+        }
+        return;
+    }
+
+    if (is_write && config.levels[0].write_strat == WRITE_STRAT_WTWNA) {
+        // No allocation: a copy in the victim buffer is refreshed, and the
+        // write goes on down either way
+        int vb_way = victims[0].ways ? victims[0].lookup(block) : -1;
+        if (vb_way != -1) {
+            stats.victim_hits++;
+            victims[0].touch(0, vb_way);
+        }
+        else {
+            stats.misses++;
+            stats.posted_write_misses++;
+        }
+        write(1, block);
+        return;
+    }
+
+    bool dirty;
+    if (take_victim(0, block, &dirty)) {
+        stats.victim_hits++;
+    }
+    else {
+        stats.misses++;
+        fetch(1, block, &dirty);
+    }
+    install(0, block, dirty || is_write);
+}
+
+// Takes block out of the level's victim buffer, if it is there
+bool HierarchySimulator::take_victim(int level, uint64_t block, bool *dirty) {
+    HierarchyLevel &buffer = victims[level];
+    int way = buffer.ways ? buffer.lookup(block) : -1;
+    if (way == -1) {
+        return false;
+    }
+    *dirty = buffer.dirty(0, way);
+    buffer.invalidate(0, way);
+    return true;
+}
+
+// A read of block from the level above. *dirty says whether the block comes
+// up dirty, which only a block leaving an exclusive level can.
+void HierarchySimulator::fetch(int level, uint64_t block, bool *dirty) {
+    *dirty = false;
+    if (level == n_levels) {
+        totals.dram_reads++;
+        return;
+    }
+    HierarchyLevel &cache = levels[level];
+    level_stats_t &stats = totals.levels[level];
+    bool exclusive = config.levels[level].inclusion == INCLUSION_EXCLUSIVE;
+    stats.accesses++;
+    uint64_t set = cache.set_of(block);
+    int way = cache.lookup(block);
+    if (way != -1) {
+        stats.hits++;
+        if (exclusive) {
+            *dirty = cache.dirty(set, way);
+            cache.invalidate(set, way);
+        }
+        else {
+            cache.touch(set, way);
+        }
+        return;
+    }
+
+    bool below_dirty;
+    if (take_victim(level, block, &below_dirty)) {
+        stats.victim_hits++;
+    }
+    else {
+        stats.misses++;
+        fetch(level + 1, block, &below_dirty);
+    }
+    if (exclusive) {
+        // Straight up, leaving no copy here
+        *dirty = below_dirty;
+        return;
+    }
+    install(level, block, below_dirty);
+}
+
+// Puts block in the level, evicting what its way held
+void HierarchySimulator::install(int level, uint64_t block, bool dirty) {
+    if (dirty && config.levels[level].write_strat == WRITE_STRAT_WTWNA) {
+        // A write-through level holds no dirty data
+        write(level + 1, block);
+        dirty = false;
+    }
+    HierarchyLevel &cache = levels[level];
+    uint64_t set = cache.set_of(block);
+    int way = cache.victim(set);
+    bool evicting = cache.valid(set, way);
+    uint64_t old_block = cache.block_at(set, way);
+    bool old_dirty = cache.dirty(set, way);
+    cache.fill(set, way, block, dirty);
+    if (evicting) {
+        evict(level, old_block, old_dirty);
+    }
+}
+
+// A block the level evicted: into its victim buffer, pushing that buffer's
+// oldest block out instead when full
+void HierarchySimulator::evict(int level, uint64_t block, bool dirty) {
+    HierarchyLevel &buffer = victims[level];
+    if (!buffer.ways) {
+        spill(level, block, dirty);
+        return;
+    }
+    int way = buffer.victim(0);
+    bool evicting = buffer.valid(0, way);
+    uint64_t old_block = buffer.block_at(0, way);
+    bool old_dirty = buffer.dirty(0, way);
+    buffer.fill(0, way, block, dirty);
+    if (evicting) {
+        spill(level, old_block, old_dirty);
+    }
+}
+
+// A block leaving the level and its victim buffer for good
+void HierarchySimulator::spill(int level, uint64_t block, bool dirty) {
+    level_stats_t &stats = totals.levels[level];
+    if (config.levels[level].inclusion == INCLUSION_INCLUSIVE) {
+        // Copies above go too, and a dirty one's data goes down with this one
+        for (int above = 0; above < level; above++) {
+            HierarchyLevel &cache = levels[above];
+            int way = cache.lookup(block);
+            if (way != -1) {
+                uint64_t set = cache.set_of(block);
+                dirty |= cache.dirty(set, way);
+                cache.invalidate(set, way);
+                stats.back_invalidations++;
+            }
+            bool buffered_dirty;
+            if (take_victim(above, block, &buffered_dirty)) {
+                dirty |= buffered_dirty;
+                stats.back_invalidations++;
+            }
+        }
+    }
+
+    int below = level + 1;
+    if (below < n_levels && config.levels[below].inclusion == INCLUSION_EXCLUSIVE) {
+        // An exclusive level takes every block evicted above it, clean or not
+        stats.write_backs += dirty;
+        level_stats_t &below_stats = totals.levels[below];
+        HierarchyLevel &cache = levels[below];
+        below_stats.writes++;
+        int way = cache.lookup(block);
+        if (way != -1) {
+            below_stats.write_hits++;
+            uint64_t set = cache.set_of(block);
+            if (dirty) cache.set_dirty(set, way);
+            cache.touch(set, way);
+            return;
+        }
+        bool buffered_dirty;
+        if (take_victim(below, block, &buffered_dirty)) {
+            below_stats.write_hits++;
+            dirty |= buffered_dirty;
+        }
+        else {
+            below_stats.write_misses++;
+        }
+        install(below, block, dirty);
+        return;
+    }
+    if (dirty) {
+        stats.write_backs++;
+        write(below, block);
+    }
+}
+
+// A write-back or write-through of block from the level above
+void HierarchySimulator::write(int level, uint64_t block) {
+    if (level == n_levels) {
+        totals.dram_writes++;
+        return;
+    }
+    HierarchyLevel &cache = levels[level];
+    level_stats_t &stats = totals.levels[level];
+    bool writes_back = config.levels[level].write_strat == WRITE_STRAT_WBWA;
+    stats.writes++;
+    uint64_t set = cache.set_of(block);
+    int way = cache.lookup(block);
+    if (way != -1) {
+        stats.write_hits++;
+        cache.touch(set, way);
+        if (writes_back) cache.set_dirty(set, way);
+        else write(level + 1, block);
+        return;
+    }
+    HierarchyLevel &buffer = victims[level];
+    way = buffer.ways ? buffer.lookup(block) : -1;
+    if (way != -1) {
+        stats.write_hits++;
+        if (writes_back) buffer.set_dirty(0, way);
+        else write(level + 1, block);
+        return;
+    }
+    stats.write_misses++;
+    // Write-backs carry the whole block, so allocating needs no read
+    if (writes_back) install(level, block, true);
+    else write(level + 1, block);
+}
+
+void HierarchySimulator::finish(hierarchy_stats_t *stats) {
+    *stats = totals;
+    stats->dram_time = DRAM_AT + DRAM_AT_PER_WORD * ((uint64_t)1 << block_bits) / WORD_SIZE;
+    double below = stats->dram_time;
+    for (int i = n_levels - 1; i >= 0; i--) {
+        const level_config_t &level = config.levels[i];
+        level_stats_t &level_stats = stats->levels[i];
+        level_stats.hit_time = level.hit_time_const + level.hit_time_per_s * level.s;
+        level_stats.miss_ratio = level_stats.accesses ? 1.0 * level_stats.misses / level_stats.accesses : 0;
+        double read_miss_ratio = level_stats.accesses
+            ? 1.0 * (level_stats.misses - level_stats.posted_write_misses) / level_stats.accesses : 0;
+        level_stats.avg_access_time = level_stats.hit_time + read_miss_ratio * below;
+        below = level_stats.avg_access_time;
+    }
+    stats->avg_access_time = below;
+}
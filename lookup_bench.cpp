@@ -0,0 +1,103 @@
+#include <stdio.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <chrono>
+#include <vector>
+#include "tag_lookup.hpp"
+
+// Tags per run, small enough to stay cache resident so the compare itself is
+// what gets measured
+static const size_t SLOTS = 1 << 12;
+static const size_t QUERIES = 1 << 16;
+
+typedef struct query {
+    uint32_t set;
+    uint64_t tag;
+} query_t;
+
+static void print_help(void) {
+    printf("lookup-bench [OPTIONS]\n");
+    printf("Times every tag lookup implementation this CPU supports on full sets\n");
+    printf("of 2, 4, 8, 16 and 32 ways.\n");
+    printf("-m MS\t\tMinimum time per measurement in milliseconds (default 200)\n");
+    printf("-r PCT\t\tPercentage of lookups that hit (default 50)\n");
+    printf("-h\t\tThis helpful output\n");
+}
+
+int main(int argc, char **argv) {
+    double min_ms = 200;
+    int hit_pct = 50;
+    int opt;
+
+    while(-1 != (opt = getopt(argc, argv, "m:r:h"))) {
+        switch(opt) {
+        case 'm':
+            min_ms = atof(optarg);
+            break;
+        case 'r':
+            hit_pct = atoi(optarg);
+            break;
+        case 'h':
+            /* Fall through */
+        default:
+            print_help();
+            return 0;
+        }
+    }
+
+    size_t n_impls;
+    const tag_find_impl_t *impls = tag_find_impls(&n_impls);
+    static const int WAYS[] = {2, 4, 8, 16, 32};
+
+    printf("ways\timpl\tMlookups/s\n");
+    srand(1);
+    for (int ways : WAYS) {
+        size_t sets = SLOTS / ways;
+        std::vector<uint64_t> tags(SLOTS);
+        for (uint64_t &tag : tags) {
+            tag = ((uint64_t)rand() << 31) ^ rand();
+        }
+        // Hits land on a uniformly chosen way; misses search the whole set
+        std::vector<query_t> queries(QUERIES);
+        for (query_t &q : queries) {
+            q.set = rand() % sets;
+            if (rand() % 100 < hit_pct) {
+                q.tag = tags[q.set * ways + rand() % ways];
+            }
+            else {
+                q.tag = ~(uint64_t)rand();
+            }
+        }
+
+        int64_t expected = 0;
+        for (size_t i = 0; i < n_impls; i++) {
+            if (!impls[i].supported) {
+                printf("%d\t%s\tunsupported\n", ways, impls[i].name);
+                continue;
+            }
+            tag_find_fn find = impls[i].find;
+            int64_t checksum = 0;
+            uint64_t lookups = 0;
+            double elapsed_ms = 0;
+            auto start = std::chrono::steady_clock::now();
+            while (elapsed_ms < min_ms) {
+                checksum = 0;
+                for (const query_t &q : queries) {
+                    checksum += find(&tags[q.set * ways], ways, q.tag);
+                }
+                lookups += QUERIES;
+                elapsed_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            }
+            if (i == 0) {
+                expected = checksum;
+            }
+            else if (checksum != expected) {
+                printf("%s disagrees with %s at %d ways\n", impls[i].name, impls[0].name, ways);
+                return 1;
+            }
+            printf("%d\t%s\t%.1f\n", ways, impls[i].name, lookups / elapsed_ms / 1e3);
+        }
+    }
+    return 0;
+}
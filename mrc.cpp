@@ -0,0 +1,143 @@
+#include "mrc.hpp"
+#include <algorithm>
+#include <string.h>
+
+static const int HASH_BITS = 24;
+static const uint64_t HASH_MODULUS = (uint64_t)1 << HASH_BITS;
+
+// splitmix64 finalizer: spreads neighbouring block addresses evenly
+static uint64_t block_hash(uint64_t block) {
+    block ^= block >> 30;
+    block *= 0xbf58476d1ce4e5b9ULL;
+    block ^= block >> 27;
+    block *= 0x94d049bb133111ebULL;
+    block ^= block >> 31;
+    return block & (HASH_MODULUS - 1);
+}
+
+void MrcSampler::setup(uint64_t b, size_t max_samples) {
+    this->b = b;
+    this->max_samples = max_samples;
+    threshold = HASH_MODULUS;
+    blocks.clear();
+    blocks.reserve(max_samples + 1);
+    by_hash = std::priority_queue<std::pair<uint64_t, uint64_t> >();
+    // Twice the tracked blocks, so compaction runs at most every
+    // max_samples references
+    fenwick.assign(2 * max_samples + 2, 0);
+    next_slot = 0;
+    memset(histogram, 0, sizeof histogram);
+    cold = 0;
+    n_references = 0;
+}
+
+double MrcSampler::sampling_rate() const {
+    return (double)threshold / HASH_MODULUS;
+}
+
+void MrcSampler::fenwick_add(size_t slot, int delta) {
+    for (size_t i = slot + 1; i < fenwick.size(); i += i & -i) {
+        fenwick[i] += delta;
+    }
+}
+
+// Live slots in [0, slot]
+uint64_t MrcSampler::fenwick_prefix(size_t slot) const {
+    uint64_t sum = 0;
+    for (size_t i = slot + 1; i > 0; i -= i & -i) {
+        sum += fenwick[i];
+    }
+    return sum;
+}
+
+// Renumbers the tracked blocks' slots 0, 1, ... in time order
+void MrcSampler::compact() {
+    std::vector<std::pair<size_t, tracked_t *> > live;
+    live.reserve(blocks.size());
+    for (auto &entry : blocks) {
+        live.push_back(std::make_pair(entry.second.slot, &entry.second));
+    }
+    std::sort(live.begin(), live.end(),
+              [](const std::pair<size_t, tracked_t *> &x, const std::pair<size_t, tracked_t *> &y) {
+                  return x.first < y.first;
+              });
+    std::fill(fenwick.begin(), fenwick.end(), 0);
+    for (size_t i = 0; i < live.size(); i++) {
+        live[i].second->slot = i;
+        fenwick_add(i, 1);
+    }
+    next_slot = live.size();
+}
+
+void MrcSampler::evict_largest() {
+    uint64_t hash = by_hash.top().first;
+    while (!by_hash.empty() && by_hash.top().first == hash) {
+        auto found = blocks.find(by_hash.top().second);
+        fenwick_add(found->second.slot, -1);
+        blocks.erase(found);
+        by_hash.pop();
+    }
+    threshold = hash;
+}
+
+void MrcSampler::track(uint64_t block, uint64_t hash) {
+    tracked_t entry;
+    entry.hash = hash;
+    entry.slot = next_slot;
+    blocks[block] = entry;
+    by_hash.push(std::make_pair(hash, block));
+    fenwick_add(next_slot++, 1);
+    while (blocks.size() > max_samples) {
+        evict_largest();
+    }
+}
+
+void MrcSampler::access(uint64_t addr) {
+    n_references++;
+    uint64_t block = addr >> b;
+    uint64_t hash = block_hash(block);
+    if (hash >= threshold) {
+        return;
+    }
+
+    if (next_slot + 1 >= fenwick.size()) {
+        compact();
+    }
+    // Each sample stands for 1/rate references
+    double weight = (double)HASH_MODULUS / threshold;
+    auto found = blocks.find(block);
+    if (found == blocks.end()) {
+        cold += weight;
+        track(block, hash);
+        return;
+    }
+
+    size_t slot = found->second.slot;
+    uint64_t distance = fenwick_prefix(next_slot - 1) - fenwick_prefix(slot);
+    uint64_t scaled = (uint64_t)(distance * weight);
+    histogram[scaled ? 64 - __builtin_clzll(scaled) : 0] += weight;
+    fenwick_add(slot, -1);
+    found->second.slot = next_slot;
+    fenwick_add(next_slot++, 1);
+}
+
+void MrcSampler::finish(uint64_t c_min, uint64_t c_max, std::vector<mrc_point_t> *points) {
+    points->clear();
+    double total = cold;
+    for (double count : histogram) {
+        total += count;
+    }
+    for (uint64_t c = std::max(c_min, b); c <= c_max; c++) {
+        // A reference hits in a cache of 2^k blocks when its distance is
+        // below 2^k, which is exactly buckets 0 through k
+        uint64_t k = c - b;
+        double hits = 0;
+        for (uint64_t bucket = 0; bucket <= k && bucket < 65; bucket++) {
+            hits += histogram[bucket];
+        }
+        mrc_point_t point;
+        point.c = c;
+        point.miss_ratio = total > 0 ? 1 - hits / total : 0;
+        points->push_back(point);
+    }
+}
@@ -0,0 +1,73 @@
+#ifndef MRC_HPP
+#define MRC_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+#include <queue>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+typedef struct mrc_point {
+    uint64_t c;
+    double miss_ratio;
+} mrc_point_t;
+
+// Approximate miss-ratio curve of a fully associative LRU cache of blocks of
+// 2^b bytes, in one pass and constant memory (SHARDS, Waldspurger et al.,
+// FAST '15, fixed-size variant).
+//
+// A block is sampled when a hash of its address falls below a threshold.
+// Each sampled reference's reuse distance, the number of distinct sampled
+// blocks touched since its previous reference, is scaled up by the sampling
+// rate and counted in a log2 histogram. At most max_samples blocks are
+// tracked; past that, the threshold drops to evict the blocks with the
+// largest hashes, so memory does not grow with the trace.
+//
+// Reuse distances come from a Fenwick tree over the tracked blocks' last
+// reference times, renumbered whenever the time slots run out.
+class MrcSampler {
+public:
+    void setup(uint64_t b, size_t max_samples);
+    void access(uint64_t addr);
+    // Points for every cache size 2^c bytes with c in [c_min, c_max]
+    void finish(uint64_t c_min, uint64_t c_max, std::vector<mrc_point_t> *points);
+
+    // Fraction of blocks sampled at the end of the trace
+    double sampling_rate() const;
+    uint64_t references() const { return n_references; }
+
+private:
+    void track(uint64_t block, uint64_t hash);
+    void evict_largest();
+    void compact();
+    void fenwick_add(size_t slot, int delta);
+    uint64_t fenwick_prefix(size_t slot) const;
+
+    typedef struct tracked {
+        uint64_t hash;
+        size_t slot;
+    } tracked_t;
+
+    uint64_t b;
+    size_t max_samples;
+    // Sample when hash < threshold, out of 2^HASH_BITS
+    uint64_t threshold;
+
+    std::unordered_map<uint64_t, tracked_t> blocks;
+    // Tracked blocks by hash, largest on top
+    std::priority_queue<std::pair<uint64_t, uint64_t> > by_hash;
+
+    // Fenwick tree over time slots; a slot holds 1 while it is some tracked
+    // block's last reference
+    std::vector<uint32_t> fenwick;
+    size_t next_slot;
+
+    // Weighted reference counts by reuse distance: bucket 0 is distance 0,
+    // bucket k holds [2^(k-1), 2^k), and cold misses count apart
+    double histogram[65];
+    double cold;
+    uint64_t n_references;
+};
+
+#endif /* MRC_HPP */
@@ -0,0 +1,410 @@
+#include "multicore.hpp"
+#include <string.h>
+#include <algorithm>
+
+// Spins briefly, then gives up the CPU, until ready() holds
+template <typename Pred>
+static void wait_until(Pred ready) {
+    for (int spins = 0; !ready(); spins++) {
+        if (spins >= 64) std::this_thread::yield();
+    }
+}
+
+MulticoreSimulator::MulticoreSimulator() : started(0), finished(0), stopping(false) {
+}
+
+MulticoreSimulator::~MulticoreSimulator() {
+    stop_workers();
+    for (core_t &core : cores) {
+        if (core.open) trace_close(&core.trace);
+    }
+}
+
+int MulticoreSimulator::setup(const sim_config_t &config, const std::vector<const char *> &paths, uint64_t epoch,
+                              unsigned threads) {
+    this->config = config;
+    this->epoch = epoch;
+    block_bits = config.l1_config.b;
+    l2_writes_back = config.l2_config.write_strat == WRITE_STRAT_WBWA;
+    n_threads = std::max(1u, std::min<unsigned>(threads, paths.size()));
+    cores.assign(paths.size(), core_t());
+    for (size_t i = 0; i < paths.size(); i++) {
+        core_t &core = cores[i];
+        if (trace_open(&core.trace, paths[i])) {
+            return 1;
+        }
+        core.open = true;
+        core.cycle = 0;
+        next_record(core);
+        core.l1.init(config.l1_config.c - config.l1_config.b - config.l1_config.s, 1 << config.l1_config.s,
+                     config.l1_config.replace_policy);
+        if (config.victim_cache_entries > 0) {
+            core.victims.init(0, config.victim_cache_entries, REPLACEMENT_POLICY_MIP);
+        }
+        memset(&core.stats, 0, sizeof core.stats);
+    }
+    l2.init(config.l2_config.c - config.l2_config.b - config.l2_config.s, 1 << config.l2_config.s,
+            config.l2_config.replace_policy);
+    l2_filler.assign(l2.tags.size(), 0);
+    directory.clear();
+    memset(&totals, 0, sizeof totals);
+    return 0;
+}
+
+// Reads the core's next record, stamping an untimed one a cycle after the
+// last
+void MulticoreSimulator::next_record(core_t &core) {
+    uint64_t cycle;
+    core.more = trace_next_timed(&core.trace, &core.rw, &core.addr, &cycle);
+    core.cycle = cycle != TRACE_NO_CYCLE ? cycle : core.cycle + 1;
+}
+
+// The core whose record comes next, or -1 when every trace has ended
+int MulticoreSimulator::next_core() const {
+    int next = -1;
+    for (size_t i = 0; i < cores.size(); i++) {
+        if (cores[i].more && (next == -1 || cores[i].cycle < cores[next].cycle)) next = i;
+    }
+    return next;
+}
+
+// The L1 and victim cache side of one access
+void MulticoreSimulator::private_access(core_t &core, char rw, uint64_t block, uint64_t seq) {
+    core_stats_t &stats = core.stats;
+    stats.accesses++;
+    if (rw == WRITE) stats.writes++;
+    else stats.reads++;
+
+    uint64_t set = core.l1.set_of(block);
+    int way = core.l1.lookup(block);
+    if (way != -1) {
+        stats.hits_l1++;
+        core.l1.touch(set, way);
+    }
+    else {
+        int victim_way = core.victims.ways ? core.victims.lookup(block) : -1;
+        if (victim_way == -1) {
+            // Shared until the directory says otherwise
+            stats.misses++;
+            install(core, block, rw == WRITE ? BLOCK_VALID | BLOCK_DIRTY : BLOCK_VALID, seq);
+            request_t request = {seq, block, rw == WRITE ? REQUEST_WRITE : REQUEST_READ, false};
+            core.requests.push_back(request);
+            return;
+        }
+        // Swap with the L1 victim, state and all
+        stats.hits_victim_cache++;
+        uint8_t state = core.victims.state(0, victim_way);
+        core.victims.invalidate(0, victim_way);
+        way = install(core, block, state, seq);
+    }
+
+    if (rw == WRITE) {
+        uint8_t &state = core.l1.state(set, way);
+        if (!(state & (BLOCK_DIRTY | BLOCK_EXCLUSIVE))) {
+            stats.upgrades++;
+            request_t request = {seq, block, REQUEST_UPGRADE, false};
+            core.requests.push_back(request);
+        }
+        state = BLOCK_VALID | BLOCK_DIRTY;
+    }
+}
+
+// Puts block in the core's L1 in the given state. The L1 victim goes to the
+// victim cache, and whatever leaves the core is reported to the directory.
+// Returns the L1 way.
+int MulticoreSimulator::install(core_t &core, uint64_t block, uint8_t state, uint64_t seq) {
+    uint64_t set = core.l1.set_of(block);
+    int way = core.l1.victim(set);
+    bool evicting = core.l1.valid(set, way);
+    uint64_t old_block = core.l1.block_at(set, way);
+    uint8_t old_state = core.l1.state(set, way);
+    core.l1.fill(set, way, block, state & BLOCK_DIRTY);
+    core.l1.state(set, way) = state;
+    if (!evicting) {
+        return way;
+    }
+
+    if (core.victims.ways) {
+        int victim_way = core.victims.victim(0);
+        if (core.victims.valid(0, victim_way)) {
+            request_t request = {seq, core.victims.block_at(0, victim_way), REQUEST_EVICT,
+                                 core.victims.dirty(0, victim_way)};
+            core.requests.push_back(request);
+        }
+        core.victims.fill(0, victim_way, old_block, old_state & BLOCK_DIRTY);
+        core.victims.state(0, victim_way) = old_state;
+    }
+    else {
+        request_t request = {seq, old_block, REQUEST_EVICT, (old_state & BLOCK_DIRTY) != 0};
+        core.requests.push_back(request);
+    }
+    return way;
+}
+
+// The core's copy of block, in L1 or the victim cache, or NULL
+uint8_t *MulticoreSimulator::find(core_t &core, uint64_t block) {
+    int way = core.l1.lookup(block);
+    if (way != -1) {
+        return &core.l1.state(core.l1.set_of(block), way);
+    }
+    way = core.victims.ways ? core.victims.lookup(block) : -1;
+    return way != -1 ? &core.victims.state(0, way) : NULL;
+}
+
+// Invalidates the core's copy of block, if it has one
+bool MulticoreSimulator::drop(core_t &core, uint64_t block, bool *dirty) {
+    int way = core.l1.lookup(block);
+    if (way != -1) {
+        uint64_t set = core.l1.set_of(block);
+        *dirty = core.l1.dirty(set, way);
+        core.l1.invalidate(set, way);
+        return true;
+    }
+    way = core.victims.ways ? core.victims.lookup(block) : -1;
+    if (way != -1) {
+        *dirty = core.victims.dirty(0, way);
+        core.victims.invalidate(0, way);
+        return true;
+    }
+    return false;
+}
+
+// The shared stage of one request from core id
+void MulticoreSimulator::resolve(unsigned id, const request_t &request) {
+    core_t &core = cores[id];
+    uint64_t bit = (uint64_t)1 << id;
+    if (request.kind == REQUEST_EVICT) {
+        if (request.dirty) {
+            core.stats.write_backs++;
+            l2_write(id, request.block);
+        }
+        auto found = directory.find(request.block);
+        if (found != directory.end() && !(found->second.sharers &= ~bit)) {
+            directory.erase(found);
+        }
+        return;
+    }
+
+    directory_entry_t &entry = directory[request.block];
+    uint64_t others = entry.sharers & ~bit;
+    if (request.kind == REQUEST_READ) {
+        if (others && entry.exclusive) {
+            unsigned owner = __builtin_ctzll(others);
+            uint8_t *state = find(cores[owner], request.block);
+            if (state) {
+                if (*state & BLOCK_DIRTY) {
+                    cores[owner].stats.coherence_write_backs++;
+                    l2_write(owner, request.block);
+                }
+                *state = BLOCK_VALID;
+                cores[owner].stats.downgrades_received++;
+            }
+        }
+        entry.exclusive = false;
+        l2_read(id, request.block);
+        // The copy may already have left again later in the epoch
+        uint8_t *state = find(core, request.block);
+        if (state) {
+            entry.sharers |= bit;
+            entry.exclusive = !others;
+            if (!others && !(*state & BLOCK_DIRTY)) *state |= BLOCK_EXCLUSIVE;
+        }
+    }
+    else {
+        for (uint64_t rest = others; rest; rest &= rest - 1) {
+            unsigned other = __builtin_ctzll(rest);
+            bool dirty;
+            if (drop(cores[other], request.block, &dirty)) {
+                if (dirty) {
+                    cores[other].stats.coherence_write_backs++;
+                    l2_write(other, request.block);
+                }
+                cores[other].stats.invalidations_received++;
+                core.stats.invalidations_sent++;
+            }
+        }
+        if (request.kind == REQUEST_WRITE) {
+            // Read for ownership
+            l2_read(id, request.block);
+        }
+        entry.sharers = find(core, request.block) ? bit : 0;
+        entry.exclusive = entry.sharers != 0;
+    }
+    if (!entry.sharers) {
+        directory.erase(request.block);
+    }
+}
+
+void MulticoreSimulator::l2_read(unsigned id, uint64_t block) {
+    cores[id].stats.reads_l2++;
+    totals.reads_l2++;
+    uint64_t set = l2.set_of(block);
+    int way = l2.lookup(block);
+    if (way != -1) {
+        totals.read_hits_l2++;
+        l2.touch(set, way);
+        return;
+    }
+    cores[id].stats.read_misses_l2++;
+    totals.read_misses_l2++;
+    totals.dram_reads++;
+    l2_fill(id, block, false);
+}
+
+void MulticoreSimulator::l2_write(unsigned id, uint64_t block) {
+    totals.writes_l2++;
+    uint64_t set = l2.set_of(block);
+    int way = l2.lookup(block);
+    if (way != -1) {
+        l2.touch(set, way);
+        if (l2_writes_back) {
+            l2.set_dirty(set, way);
+            return;
+        }
+    }
+    else if (l2_writes_back) {
+        // Write-backs carry the whole block
+        l2_fill(id, block, true);
+        return;
+    }
+    totals.dram_writes++;
+}
+
+void MulticoreSimulator::l2_fill(unsigned id, uint64_t block, bool dirty) {
+    uint64_t set = l2.set_of(block);
+    int way = l2.victim(set);
+    uint8_t &filler = l2_filler[(set << l2.s) + way];
+    if (l2.valid(set, way)) {
+        if (l2.dirty(set, way)) {
+            totals.dram_writes++;
+        }
+        if (filler != id) {
+            cores[filler].stats.l2_evictions_by_others++;
+            totals.cross_core_evictions++;
+        }
+    }
+    l2.fill(set, way, block, dirty);
+    filler = id;
+}
+
+void MulticoreSimulator::run() {
+    if (epoch) {
+        run_epochs();
+        return;
+    }
+    uint64_t seq = 0;
+    for (int id; (id = next_core()) != -1; seq++) {
+        core_t &core = cores[id];
+        private_access(core, core.rw, core.addr >> block_bits, seq);
+        for (const request_t &request : core.requests) {
+            resolve(id, request);
+        }
+        core.requests.clear();
+        next_record(core);
+    }
+}
+
+// Worker thread: the private stages of cores first, first + n_threads, ...
+void MulticoreSimulator::worker(unsigned first) {
+    for (uint64_t seen = 0;;) {
+        wait_until([&] { return started.load(std::memory_order_acquire) != seen; });
+        seen++;
+        if (stopping.load(std::memory_order_relaxed)) {
+            return;
+        }
+        for (size_t i = first; i < cores.size(); i += n_threads) {
+            core_t &core = cores[i];
+            for (size_t j = 0; j < core.records.size(); j++) {
+                private_access(core, core.records[j].rw, core.records[j].addr >> block_bits, core.seqs[j]);
+            }
+        }
+        finished.fetch_add(1, std::memory_order_release);
+    }
+}
+
+void MulticoreSimulator::stop_workers() {
+    if (workers.empty()) {
+        return;
+    }
+    stopping.store(true, std::memory_order_relaxed);
+    started.fetch_add(1, std::memory_order_release);
+    for (std::thread &thread : workers) {
+        thread.join();
+    }
+    workers.clear();
+}
+
+void MulticoreSimulator::run_epochs() {
+    for (unsigned t = 0; t < n_threads; t++) {
+        workers.emplace_back(&MulticoreSimulator::worker, this, t);
+    }
+    typedef std::pair<uint64_t, unsigned> position_t;
+    std::vector<std::pair<position_t, const request_t *> > order;
+    uint64_t seq = 0;
+    for (;;) {
+        for (core_t &core : cores) {
+            core.records.clear();
+            core.seqs.clear();
+            core.requests.clear();
+        }
+        uint64_t n = 0;
+        for (int id; n < epoch && (id = next_core()) != -1; n++, seq++) {
+            core_t &core = cores[id];
+            access_t record = {core.addr, core.rw};
+            core.records.push_back(record);
+            core.seqs.push_back(seq);
+            next_record(core);
+        }
+        if (!n) {
+            break;
+        }
+        totals.epochs++;
+
+        finished.store(0, std::memory_order_relaxed);
+        started.fetch_add(1, std::memory_order_release);
+        wait_until([&] { return finished.load(std::memory_order_acquire) == n_threads; });
+
+        // The shared stage, in interleave order; a core's requests for one
+        // access keep the order it made them in
+        order.clear();
+        for (unsigned id = 0; id < cores.size(); id++) {
+            for (const request_t &request : cores[id].requests) {
+                order.push_back(std::make_pair(position_t(request.seq, id), &request));
+            }
+        }
+        std::stable_sort(order.begin(), order.end(),
+                         [](const std::pair<position_t, const request_t *> &a,
+                            const std::pair<position_t, const request_t *> &b) { return a.first < b.first; });
+        for (auto &entry : order) {
+            resolve(entry.first.second, *entry.second);
+        }
+    }
+    stop_workers();
+}
+
+void MulticoreSimulator::finish(std::vector<core_stats_t> *stats_out, multicore_stats_t *stats) {
+    *stats = totals;
+    double hit_time_l1 = L1_HIT_TIME_CONST + config.l1_config.s * L1_HIT_TIME_PER_S;
+    double hit_time_l2 = L2_HIT_TIME_CONST + config.l2_config.s * L2_HIT_TIME_PER_S;
+    double dram_time = DRAM_AT + DRAM_AT_PER_WORD * ((uint64_t)1 << block_bits) / WORD_SIZE;
+    stats->read_miss_ratio_l2 = totals.reads_l2 ? 1.0 * totals.read_misses_l2 / totals.reads_l2 : 0;
+    stats->avg_access_time_l2 = hit_time_l2 + stats->read_miss_ratio_l2 * dram_time;
+
+    stats_out->clear();
+    double time = 0;
+    uint64_t accesses = 0;
+    for (core_t &core : cores) {
+        core_stats_t core_stats = core.stats;
+        double l2_miss_ratio = core_stats.reads_l2 ? 1.0 * core_stats.read_misses_l2 / core_stats.reads_l2 : 0;
+        core_stats.miss_ratio = core_stats.accesses ? 1.0 * core_stats.misses / core_stats.accesses : 0;
+        core_stats.avg_access_time = hit_time_l1;
+        if (core_stats.accesses) {
+            core_stats.avg_access_time += core_stats.miss_ratio * (hit_time_l2 + l2_miss_ratio * dram_time)
+                                          + 1.0 * core_stats.upgrades / core_stats.accesses * hit_time_l2;
+        }
+        time += core_stats.avg_access_time * core_stats.accesses;
+        accesses += core_stats.accesses;
+        stats_out->push_back(core_stats);
+    }
+    stats->avg_access_time = accesses ? time / accesses : 0;
+}
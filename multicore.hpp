@@ -0,0 +1,181 @@
+#ifndef MULTICORE_HPP
+#define MULTICORE_HPP
+
+#include "hierarchy.hpp"
+#include "trace.hpp"
+#include <atomic>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Cores the sharer bit masks have room for
+static const unsigned MULTICORE_MAX_CORES = 64;
+// Epoch length for threaded runs when --epoch is left out
+static const uint64_t MULTICORE_DEFAULT_EPOCH = 4096;
+
+// MESI states of a private copy, in the flags byte: Shared is BLOCK_VALID
+// alone, Modified adds BLOCK_DIRTY, Exclusive adds BLOCK_EXCLUSIVE
+static const uint8_t BLOCK_EXCLUSIVE = 8;
+
+typedef struct core_stats {
+    uint64_t reads;
+    uint64_t writes;
+    uint64_t accesses;
+    uint64_t hits_l1;
+    uint64_t hits_victim_cache;
+    // Missed both L1 and the victim cache
+    uint64_t misses;
+    // Write hits on Shared copies, which must invalidate the others first
+    uint64_t upgrades;
+    // Copies of other cores this core's writes invalidated, and copies of
+    // its own other cores' writes invalidated
+    uint64_t invalidations_sent;
+    uint64_t invalidations_received;
+    // Exclusive or Modified copies another core's read turned Shared
+    uint64_t downgrades_received;
+    // Modified copies written back to L2 because another core wanted them
+    uint64_t coherence_write_backs;
+    // Modified copies written back on eviction
+    uint64_t write_backs;
+    uint64_t reads_l2;
+    uint64_t read_misses_l2;
+    // L2 blocks this core brought in that another core's fill evicted
+    uint64_t l2_evictions_by_others;
+    // Filled in by finish()
+    double miss_ratio;
+    double avg_access_time;
+} core_stats_t;
+
+typedef struct multicore_stats {
+    uint64_t reads_l2;
+    uint64_t read_hits_l2;
+    uint64_t read_misses_l2;
+    uint64_t writes_l2;
+    // L2 evictions of a block another core brought in: the cores competing
+    // for the shared capacity
+    uint64_t cross_core_evictions;
+    uint64_t dram_reads;
+    uint64_t dram_writes;
+    uint64_t epochs;
+    // Filled in by finish(); the AAT is over every core's accesses
+    double read_miss_ratio_l2;
+    double avg_access_time_l2;
+    double avg_access_time;
+} multicore_stats_t;
+
+// Several cores, one trace each, with private L1s and victim caches in
+// front of a shared L2, kept coherent by MESI through a directory of the
+// cores holding each block, for --multicore. Records are interleaved by
+// the cycle a text record gives after its address; a record without one
+// comes a cycle after its core's last, so untimed traces go round-robin.
+// Ties go to the lower core.
+//
+// Each access first runs a core's private stage: its L1 and victim cache,
+// which hit or install the block and queue requests for the shared stage
+// (read and write misses, upgrades, and blocks leaving the core). The
+// shared stage applies them to the directory and L2: a read of a block
+// another core holds Exclusive or Modified downgrades that copy, writing it
+// back if Modified; a write invalidates every other copy; a read nobody
+// else holds is granted Exclusive.
+//
+// With epoch 0 the shared stage follows each access at once, which is
+// exact. Otherwise the records are cut into epochs of that many; each
+// epoch, threads run the cores' private stages side by side, and the
+// shared stage then applies their requests in interleave order. Coherence
+// then lags by up to an epoch: a core keeps hitting a copy another core's
+// earlier write invalidates until the epoch ends, and read misses install
+// Shared until the directory grants Exclusive. Results depend on the epoch
+// length, never on the thread count.
+//
+// Private L1s are write-back; L2 may be either, and is neither inclusive
+// nor exclusive of them, so its evictions leave the L1 copies alone. The
+// AAT charges an L2 hit time for each upgrade, the directory's round trip.
+class MulticoreSimulator {
+public:
+    MulticoreSimulator();
+    ~MulticoreSimulator();
+
+    // Opens each core's trace. Returns nonzero, after a message, when one
+    // cannot be opened.
+    int setup(const sim_config_t &config, const std::vector<const char *> &paths, uint64_t epoch, unsigned threads);
+    void run();
+    void finish(std::vector<core_stats_t> *cores, multicore_stats_t *stats);
+
+private:
+    typedef enum request_kind {
+        REQUEST_READ,
+        REQUEST_WRITE,
+        REQUEST_UPGRADE,
+        REQUEST_EVICT,
+    } request_kind_t;
+
+    typedef struct request {
+        // Position of the access behind it in the interleaved trace
+        uint64_t seq;
+        uint64_t block;
+        request_kind_t kind;
+        bool dirty;
+    } request_t;
+
+    typedef struct core {
+        trace_file_t trace;
+        bool open;
+        // The core's next record, and whether there is one
+        bool more;
+        char rw;
+        uint64_t addr;
+        uint64_t cycle;
+        HierarchyLevel l1;
+        HierarchyLevel victims;
+        core_stats_t stats;
+        // This epoch's records and their positions, and the requests they
+        // left for the shared stage
+        std::vector<access_t> records;
+        std::vector<uint64_t> seqs;
+        std::vector<request_t> requests;
+    } core_t;
+
+    typedef struct directory_entry {
+        uint64_t sharers;
+        // The one sharer holds it Exclusive or Modified
+        bool exclusive;
+    } directory_entry_t;
+
+    MulticoreSimulator(const MulticoreSimulator &);
+    MulticoreSimulator &operator=(const MulticoreSimulator &);
+
+    void next_record(core_t &core);
+    int next_core() const;
+    void private_access(core_t &core, char rw, uint64_t block, uint64_t seq);
+    int install(core_t &core, uint64_t block, uint8_t state, uint64_t seq);
+    uint8_t *find(core_t &core, uint64_t block);
+    bool drop(core_t &core, uint64_t block, bool *dirty);
+    void resolve(unsigned id, const request_t &request);
+    void l2_read(unsigned id, uint64_t block);
+    void l2_write(unsigned id, uint64_t block);
+    void l2_fill(unsigned id, uint64_t block, bool dirty);
+    void run_epochs();
+    void worker(unsigned first);
+    void stop_workers();
+
+    sim_config_t config;
+    uint64_t block_bits;
+    bool l2_writes_back;
+    uint64_t epoch;
+    unsigned n_threads;
+    std::vector<core_t> cores;
+    HierarchyLevel l2;
+    // The core whose fill brought in each L2 way's block
+    std::vector<uint8_t> l2_filler;
+    std::unordered_map<uint64_t, directory_entry_t> directory;
+    multicore_stats_t totals;
+
+    // Epoch handshake: the coordinator bumps started to run the private
+    // stages; each worker thread adds to finished when its cores are done
+    std::vector<std::thread> workers;
+    std::atomic<uint64_t> started;
+    std::atomic<unsigned> finished;
+    std::atomic<bool> stopping;
+};
+
+#endif /* MULTICORE_HPP */
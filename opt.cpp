@@ -0,0 +1,155 @@
+#include "opt.hpp"
+#include "simulator.hpp"
+#include <string.h>
+#include <sys/types.h>
+#include <unordered_map>
+
+// Trace records simulated per batch in the first pass
+static const size_t OPT_BATCH = 1 << 16;
+// L2 reads held in memory at a time by either pass
+static const size_t OPT_WINDOW = 1 << 20;
+// Distance stored for OPT_NEVER
+static const uint32_t DISTANCE_NEVER = UINT32_MAX;
+
+NextUseIndex::NextUseIndex() : distances(NULL), n_reads(0), window_pos(0), position(0) {
+}
+
+NextUseIndex::~NextUseIndex() {
+    clear();
+}
+
+void NextUseIndex::clear() {
+    if (distances) {
+        fclose(distances);
+    }
+    distances = NULL;
+    n_reads = 0;
+    window.clear();
+    window_pos = 0;
+    position = 0;
+}
+
+// The block address of every L2 read, in order. L2 itself cannot change
+// what reaches it, so it is left out. Returns nonzero when a write fails,
+// and negative, after a message, when memory runs out.
+static int spill_l2_reads(const sim_config_t &config, trace_file_t *trace, FILE *blocks, uint64_t *n_reads) {
+    sim_config_t l1_only = config;
+    l1_only.l2_config.disabled = 1;
+    Simulator sim;
+    sim.setup(l1_only);
+    trace_buffer_t stream;
+    memset(&stream, 0, sizeof stream);
+    sim.record_l2_stream(&stream);
+    sim_stats_t stats;
+    memset(&stats, 0, sizeof stats);
+
+    std::vector<access_t> batch;
+    batch.reserve(OPT_BATCH);
+    std::vector<uint64_t> reads;
+    *n_reads = 0;
+    bool more = true;
+    while (more) {
+        batch.clear();
+        access_t record;
+        while (batch.size() < OPT_BATCH && (more = trace_next(trace, &record.rw, &record.addr))) {
+            batch.push_back(record);
+        }
+        sim.access_batch(batch.data(), batch.size(), &stats);
+        if (sim.l2_stream_failed()) {
+            printf("Out of memory recording the L2 reads for OPT\n");
+            trace_buffer_free(&stream);
+            return -1;
+        }
+
+        trace_file_t reader;
+        trace_buffer_reader(&stream, &reader);
+        reads.clear();
+        char rw;
+        uint64_t addr;
+        while (trace_next(&reader, &rw, &addr)) {
+            if (rw == READ) reads.push_back(addr >> config.l2_config.b);
+        }
+        trace_buffer_clear(&stream);
+        if (fwrite(reads.data(), sizeof(uint64_t), reads.size(), blocks) != reads.size()) {
+            trace_buffer_free(&stream);
+            return 1;
+        }
+        *n_reads += reads.size();
+    }
+    trace_buffer_free(&stream);
+    return 0;
+}
+
+// Walks the spilled reads backwards a window at a time, writing each one's
+// distance to the next read of its block to the same position of distances
+static int index_next_uses(FILE *blocks, uint64_t n_reads, FILE *distances) {
+    std::unordered_map<uint64_t, uint64_t> latest;
+    std::vector<uint64_t> block(OPT_WINDOW);
+    std::vector<uint32_t> distance(OPT_WINDOW);
+    for (uint64_t end = n_reads; end > 0;) {
+        uint64_t start = end > OPT_WINDOW ? end - OPT_WINDOW : 0;
+        size_t n = end - start;
+        if (fseeko(blocks, (off_t)(start * sizeof(uint64_t)), SEEK_SET)
+            || fread(block.data(), sizeof(uint64_t), n, blocks) != n) {
+            return 1;
+        }
+        for (size_t i = n; i-- > 0;) {
+            uint64_t pos = start + i;
+            auto found = latest.find(block[i]);
+            if (found == latest.end()) {
+                distance[i] = DISTANCE_NEVER;
+                latest.emplace(block[i], pos);
+                continue;
+            }
+            uint64_t d = found->second - pos;
+            distance[i] = d < DISTANCE_NEVER ? d : DISTANCE_NEVER;
+            found->second = pos;
+        }
+        if (fseeko(distances, (off_t)(start * sizeof(uint32_t)), SEEK_SET)
+            || fwrite(distance.data(), sizeof(uint32_t), n, distances) != n) {
+            return 1;
+        }
+        end = start;
+    }
+    return 0;
+}
+
+int NextUseIndex::build(const sim_config_t &config, trace_file_t *trace) {
+    clear();
+    FILE *blocks = tmpfile();
+    distances = tmpfile();
+    if (!blocks || !distances) {
+        printf("Could not create temporary files for OPT\n");
+        if (blocks) fclose(blocks);
+        clear();
+        return 1;
+    }
+    int failed = spill_l2_reads(config, trace, blocks, &n_reads);
+    if (!failed) {
+        failed = index_next_uses(blocks, n_reads, distances) || fflush(distances);
+    }
+    fclose(blocks);
+    if (failed) {
+        if (failed > 0) printf("Could not write temporary files for OPT\n");
+        clear();
+        return 1;
+    }
+    rewind(distances);
+    return 0;
+}
+
+uint64_t NextUseIndex::next() {
+    uint64_t pos = position++;
+    if (window_pos == window.size()) {
+        window.resize(OPT_WINDOW);
+        size_t n = distances ? fread(window.data(), sizeof(uint32_t), OPT_WINDOW, distances) : 0;
+        window.resize(n);
+        window_pos = 0;
+        if (!n) {
+            // Past the end of the index
+            return OPT_NEVER;
+        }
+    }
+    uint32_t d = window[window_pos++];
+    return d == DISTANCE_NEVER ? OPT_NEVER : pos + d;
+}
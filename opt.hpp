@@ -0,0 +1,62 @@
+#ifndef OPT_HPP
+#define OPT_HPP
+
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+#include "cachesim.hpp"
+#include "trace.hpp"
+
+// Next-use index for Belady's OPT at L2. OPT evicts the block read again
+// farthest in the future, so it needs, at every L2 read, when the same block
+// is next read. The L2 read stream depends only on L1 and the victim cache,
+// so build() finds it ahead of time:
+//
+//   1. Simulates L1 and the victim cache over the trace and spills the block
+//      address of every L2 read to a temporary file.
+//   2. Walks the spill backwards a window at a time, remembering each
+//      block's latest position, and writes every read's distance to the next
+//      read of its block to a second file.
+//
+// The simulation then reads the distances back in order, a window at a
+// time. Memory is a window of each plus one entry per distinct block; the
+// files take 12 bytes per L2 read.
+class NextUseIndex {
+public:
+    NextUseIndex();
+    ~NextUseIndex();
+
+    // Reads trace to the end. Returns nonzero and prints a message on
+    // failure.
+    int build(const sim_config_t &config, trace_file_t *trace);
+    // Drops the index
+    void clear();
+
+    // Position in the L2 read stream of the next read of the block being
+    // read now, or OPT_NEVER. Call once per L2 read, in order.
+    uint64_t next();
+
+    // L2 reads indexed by build()
+    uint64_t reads() const { return n_reads; }
+
+private:
+    NextUseIndex(const NextUseIndex &);
+    NextUseIndex &operator=(const NextUseIndex &);
+
+    // uint32 distance to the next read, one per L2 read
+    FILE *distances;
+    uint64_t n_reads;
+    std::vector<uint32_t> window;
+    size_t window_pos;
+    uint64_t position;
+};
+
+// Blocks not read again, or not within 2^32 - 1 L2 reads
+static const uint64_t OPT_NEVER = UINT64_MAX;
+
+// Builds the index for the simulator behind sim_setup(), which must already
+// be set up with REPLACEMENT_POLICY_OPT. The trace must then be rewound for
+// the simulation itself.
+extern int sim_plan_opt(trace_file_t *trace);
+
+#endif /* OPT_HPP */
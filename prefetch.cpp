@@ -0,0 +1,72 @@
+#include "prefetch.hpp"
+#include <algorithm>
+
+void Prefetcher::init(const prefetch_config_t &config, uint64_t block_bits) {
+    this->config = config;
+    this->config.degree = std::min(config.degree, PREFETCH_MAX_DEGREE);
+    region_shift = PREFETCH_REGION_BITS > block_bits ? PREFETCH_REGION_BITS - block_bits : 0;
+    strides.assign(config.kind == PREFETCHER_STRIDE ? PREFETCH_STRIDE_ENTRIES : 0, stride_entry_t());
+    streams.assign(config.kind == PREFETCHER_STREAM ? PREFETCH_STREAMS : 0, stream_t());
+    misses = 0;
+}
+
+// degree blocks step apart, the first distance steps past block
+unsigned Prefetcher::ahead(uint64_t block, int64_t step, uint64_t *blocks) const {
+    for (uint64_t i = 0; i < config.degree; i++) {
+        blocks[i] = block + step * (int64_t)(config.distance + i);
+    }
+    return config.degree;
+}
+
+unsigned Prefetcher::train(uint64_t block, uint64_t *blocks) {
+    misses++;
+    if (config.kind == PREFETCHER_NEXT_LINE) {
+        return ahead(block, 1, blocks);
+    }
+
+    if (config.kind == PREFETCHER_STRIDE) {
+        uint64_t region = block >> region_shift;
+        stride_entry_t &entry = strides[(region * 0x9e3779b97f4a7c15ULL) >> 58];
+        if (!entry.valid || entry.region != region) {
+            entry.valid = true;
+            entry.region = region;
+            entry.last = block;
+            entry.stride = 0;
+            entry.confirmed = false;
+            return 0;
+        }
+        int64_t stride = block - entry.last;
+        entry.confirmed = stride != 0 && stride == entry.stride;
+        entry.stride = stride;
+        entry.last = block;
+        return entry.confirmed ? ahead(block, stride, blocks) : 0;
+    }
+
+    if (config.kind == PREFETCHER_STREAM) {
+        stream_t *oldest = &streams[0];
+        for (stream_t &stream : streams) {
+            if (!stream.valid) {
+                if (oldest->valid) oldest = &stream;
+                continue;
+            }
+            int64_t delta = block - stream.last;
+            bool near = delta != 0 && delta <= PREFETCH_STREAM_WINDOW && delta >= -PREFETCH_STREAM_WINDOW;
+            if (near && (!stream.direction || (delta > 0) == (stream.direction > 0))) {
+                bool confirmed = stream.direction != 0;
+                stream.direction = delta > 0 ? 1 : -1;
+                stream.last = block;
+                stream.touched = misses;
+                return confirmed ? ahead(block, stream.direction, blocks) : 0;
+            }
+            if (oldest->valid && stream.touched < oldest->touched) {
+                oldest = &stream;
+            }
+        }
+        oldest->valid = true;
+        oldest->last = block;
+        oldest->direction = 0;
+        oldest->touched = misses;
+        return 0;
+    }
+    return 0;
+}
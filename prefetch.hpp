@@ -0,0 +1,102 @@
+#ifndef PREFETCH_HPP
+#define PREFETCH_HPP
+
+#include <stdint.h>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "cachesim.hpp"
+
+// Most blocks one trigger may ask for
+static const uint64_t PREFETCH_MAX_DEGREE = 16;
+// Stride tables cover memory in regions of 2^PREFETCH_REGION_BITS bytes
+static const unsigned PREFETCH_REGION_BITS = 12;
+static const unsigned PREFETCH_STRIDE_ENTRIES = 64;
+// Streams tracked at once, and how many blocks past its last miss a miss may
+// fall and still extend a stream
+static const unsigned PREFETCH_STREAMS = 16;
+static const int64_t PREFETCH_STREAM_WINDOW = 16;
+
+// The prefetch engines. Each is trained on one level's demand misses, by
+// block address, and answers with the blocks to fetch, which the simulator
+// fills into that level marked as prefetched:
+//
+//   NEXT_LINE  blocks distance .. distance + degree - 1 past the miss.
+//   STRIDE     no PC in the trace, so strides are learned per region of
+//              memory: a direct-mapped table remembers each region's last
+//              miss and the distance to the one before, and once the same
+//              stride comes twice in a row fetches degree strides starting
+//              distance strides ahead.
+//   STREAM     stream buffers, tracking PREFETCH_STREAMS runs of misses
+//              that move the same way. A miss near a stream's last one sets
+//              or confirms its direction; a confirmed stream fetches degree
+//              blocks starting distance ahead. Misses that fit no stream
+//              replace the least recently extended one.
+//
+// Instead of holding prefetched blocks in FIFOs of their own, the stream
+// engine fills the cache like the others, so all three are measured the
+// same way.
+class Prefetcher {
+public:
+    void init(const prefetch_config_t &config, uint64_t block_bits);
+    bool enabled() const { return config.kind != PREFETCHER_NONE; }
+    // Learns from a demand miss on block. Returns how many blocks to fetch,
+    // at most PREFETCH_MAX_DEGREE, written to blocks.
+    unsigned train(uint64_t block, uint64_t *blocks);
+
+private:
+    unsigned ahead(uint64_t block, int64_t step, uint64_t *blocks) const;
+
+    typedef struct stride_entry {
+        uint64_t region;
+        uint64_t last;
+        int64_t stride;
+        bool valid;
+        bool confirmed;
+    } stride_entry_t;
+
+    typedef struct stream {
+        uint64_t last;
+        int64_t direction;
+        uint64_t touched;
+        bool valid;
+    } stream_t;
+
+    prefetch_config_t config;
+    unsigned region_shift;
+    std::vector<stride_entry_t> strides;
+    std::vector<stream_t> streams;
+    uint64_t misses;
+};
+
+// Bookkeeping for the blocks one level prefetched: when each unused one
+// would have arrived, and the blocks prefetches pushed out, as in the
+// pollution filter of Srinath et al. (HPCA '07). Hardware hashes these into
+// a small bit vector; with no budget to meet, the set here is exact, so a
+// demand miss counts as pollution only when a prefetch really evicted it.
+struct PrefetchTracker {
+    std::unordered_map<uint64_t, double> ready_at;
+    // Blocks a prefetch pushed out that have not been back in the level since
+    std::unordered_set<uint64_t> evicted;
+
+    void init() {
+        ready_at.clear();
+        evicted.clear();
+    }
+
+    void mark_evicted(uint64_t block) {
+        evicted.insert(block);
+    }
+
+    // The block is back in the level, however it got there
+    void refilled(uint64_t block) {
+        evicted.erase(block);
+    }
+
+    // Whether a prefetch pushed block out since it was last in the level
+    bool take_evicted(uint64_t block) {
+        return evicted.erase(block) != 0;
+    }
+};
+
+#endif /* PREFETCH_HPP */
@@ -0,0 +1,60 @@
+#ifndef PROFILE_HPP
+#define PROFILE_HPP
+
+#include <stdint.h>
+#include <chrono>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Hot-path profiling, compiled in with -DPROFILE (make PROFILE=1). Each
+// access is split into consecutive phases and the time between phase
+// boundaries is charged to the phase that just ended, so the phases add up
+// to the whole of the simulation. Without PROFILE the hooks are empty.
+
+typedef enum profile_phase {
+    // L1 tag probe, and the MRU update on a hit
+    PROFILE_L1_PROBE,
+    // Victim cache scan, and the swap on a hit
+    PROFILE_VICTIM_CACHE,
+    // L2 tag probe, and the recency update on a hit
+    PROFILE_L2_LOOKUP,
+    // L2 victim choice and fill on a read miss
+    PROFILE_L2_FILL,
+    // A dirty block leaving L1 or the victim cache for L2
+    PROFILE_WRITE_BACK,
+    // Installing the missed block in L1, moving its victim to the victim cache
+    PROFILE_L1_FILL,
+    PROFILE_PHASES,
+} profile_phase_t;
+
+typedef struct sim_profile {
+    uint64_t ticks[PROFILE_PHASES];
+    uint64_t events[PROFILE_PHASES];
+} sim_profile_t;
+
+static const char *const PROFILE_PHASE_NAMES[PROFILE_PHASES] = {
+    "L1 probe", "Victim cache", "L2 lookup", "L2 fill", "Write-back", "L1 fill",
+};
+
+// The time stamp counter where there is one, nanoseconds otherwise. Tick
+// rates differ between machines; calibrate against steady_clock.
+static inline uint64_t profile_ticks(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+// The profile of the simulator behind sim_setup()/sim_access()
+extern const sim_profile_t *sim_profile(void);
+
+#ifdef PROFILE
+static const bool PROFILE_ENABLED = true;
+#else
+static const bool PROFILE_ENABLED = false;
+#endif
+
+#endif /* PROFILE_HPP */
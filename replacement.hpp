@@ -0,0 +1,102 @@
+#ifndef REPLACEMENT_HPP
+#define REPLACEMENT_HPP
+
+#include <stdint.h>
+#include "cachesim.hpp"
+
+// Bit-packed per-set state for the policies that do not keep a full recency
+// order: a tree of ways - 1 bits for TREE_PLRU, and a 2-bit re-reference
+// prediction value (RRPV) per way for the RRIP family (Jaleel et al., ISCA
+// '10). OPT, the exception, keeps each way's next-use position in a word. A
+// set's state is policy_state_words() uint64s, zero when empty.
+
+static inline bool policy_is_rrip(replacement_policy_t policy) {
+    return policy == REPLACEMENT_POLICY_SRRIP || policy == REPLACEMENT_POLICY_BRRIP
+        || policy == REPLACEMENT_POLICY_DRRIP;
+}
+
+// 0 for the policies that order the set by rank instead
+static inline uint64_t policy_state_words(replacement_policy_t policy, uint64_t ways) {
+    if (policy == REPLACEMENT_POLICY_TREE_PLRU) return (ways + 63) / 64;
+    if (policy_is_rrip(policy)) return (2 * ways + 63) / 64;
+    if (policy == REPLACEMENT_POLICY_OPT) return ways;
+    return 0;
+}
+
+// Tree-PLRU over a heap of nodes 1 .. ways - 1 with way w at leaf ways + w.
+// Each node's bit points at the half to evict from next, 0 for the left.
+static inline bool plru_bit(const uint64_t *tree, uint64_t node) {
+    return tree[node / 64] >> (node % 64) & 1;
+}
+
+// Points every node on the way's path away from it
+static inline void plru_touch(uint64_t *tree, int ways, int way) {
+    for (uint64_t node = ways + way; node > 1; node /= 2) {
+        uint64_t parent = node / 2;
+        uint64_t bit = (uint64_t)1 << (parent % 64);
+        if (node % 2 == 0) tree[parent / 64] |= bit;
+        else tree[parent / 64] &= ~bit;
+    }
+}
+
+static inline int plru_victim(const uint64_t *tree, int ways) {
+    uint64_t node = 1;
+    while (node < (uint64_t)ways) {
+        node = 2 * node + plru_bit(tree, node);
+    }
+    return node - ways;
+}
+
+// RRPVs: 0 is re-referenced soonest, RRPV_DISTANT is the eviction candidate
+static const unsigned RRPV_LONG = 2;
+static const unsigned RRPV_DISTANT = 3;
+// BRRIP inserts one block in this many at RRPV_LONG, the rest at RRPV_DISTANT
+static const unsigned BRRIP_THROTTLE = 32;
+// DRRIP's policy selector counts leader set misses in 10 bits, SRRIP leader
+// misses up; followers insert like BRRIP from the midpoint on
+static const unsigned DRRIP_PSEL_MAX = 1023;
+static const unsigned DRRIP_PSEL_INIT = 512;
+
+static inline void rrpv_set(uint64_t *rrpv, int way, unsigned value) {
+    unsigned shift = 2 * (way % 32);
+    rrpv[way / 32] = (rrpv[way / 32] & ~((uint64_t)3 << shift)) | ((uint64_t)value << shift);
+}
+
+// The lowest way at RRPV_DISTANT in a full set, after ageing every way until
+// one gets there. Works a word of 32 ways at a time.
+static inline int rrip_victim(uint64_t *rrpv, int ways) {
+    const uint64_t LOW = 0x5555555555555555ULL;
+    const uint64_t mask = ways >= 32 ? LOW : LOW & (((uint64_t)1 << (2 * ways)) - 1);
+    const int words = (ways + 31) / 32;
+    for (;;) {
+        for (int k = 0; k < words; k++) {
+            uint64_t distant = rrpv[k] & (rrpv[k] >> 1) & mask;
+            if (distant) return 32 * k + __builtin_ctzll(distant) / 2;
+        }
+        // No way is at RRPV_DISTANT, so no field carries into the next
+        for (int k = 0; k < words; k++) {
+            rrpv[k] += mask;
+        }
+    }
+}
+
+// The way read again last, the lowest of those never read again
+static inline int opt_victim(const uint64_t *next_use, int ways) {
+    int victim = 0;
+    for (int w = 1; w < ways; w++) {
+        if (next_use[w] > next_use[victim]) victim = w;
+    }
+    return victim;
+}
+
+// DRRIP leader sets by complement select on the set index: of every 1024
+// sets, 32 always insert like SRRIP (1) and 32 like BRRIP (2)
+static inline int drrip_leader(uint64_t index) {
+    uint64_t low = index & 31;
+    uint64_t high = (index >> 5) & 31;
+    if (low == high) return 1;
+    if (low == (~high & 31)) return 2;
+    return 0;
+}
+
+#endif /* REPLACEMENT_HPP */
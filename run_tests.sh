@@ -63,4 +63,42 @@ for TRACE in "${TRACES[@]}"; do
 
 done
 
+# 6. Sampling where every measured window hits L1: the AAT must stay defined
+FAILED=0
+HOT_TRACE=$(mktemp)
+HOT_STATS=$(mktemp)
+trap 'rm -f $HOT_TRACE $HOT_STATS' EXIT
+for i in $(seq 2000); do echo "R 0x1000"; done > $HOT_TRACE
+CMD="./cachesim --sample=500,0,500 < $HOT_TRACE"
+echo $CMD | tee -a $OUTPUT_LOG
+if eval $CMD | tee -a $OUTPUT_LOG | grep -i "AAT" | grep -qi nan; then
+    echo "FAILED: NaN in the sampled AAT" | tee -a $OUTPUT_LOG
+    FAILED=1
+fi
+
+# 7. Interval statistics over the same loop: only undefined ratios are null
+CMD="./cachesim --stats-interval 500 --stats-file $HOT_STATS < $HOT_TRACE"
+echo $CMD | tee -a $OUTPUT_LOG
+eval $CMD >> $OUTPUT_LOG
+if grep -q '"aat_l[12]": null' $HOT_STATS; then
+    echo "FAILED: null AAT in the interval statistics" | tee -a $OUTPUT_LOG
+    FAILED=1
+fi
+
+# 8. A sampled run must keep the write traffic below L1: with a write-back
+# L2, a trace that writes reaches DRAM
+WRITE_TRACE=$(mktemp)
+trap 'rm -f $HOT_TRACE $HOT_STATS $WRITE_TRACE' EXIT
+for i in $(seq 0 19999); do printf "W 0x%x\n" $((i * 64)); done > $WRITE_TRACE
+CMD="./cachesim -W wbwa --sample=1000,100,200 < $WRITE_TRACE"
+echo $CMD | tee -a $OUTPUT_LOG
+if eval $CMD | tee -a $OUTPUT_LOG | grep -q "^DRAM writes: 0$"; then
+    echo "FAILED: no DRAM writes in a sampled write-back run" | tee -a $OUTPUT_LOG
+    FAILED=1
+fi
+
+if [[ $FAILED -ne 0 ]]; then
+    echo "Some checks failed!" | tee -a $OUTPUT_LOG
+    exit 1
+fi
 echo "All tests completed!" | tee -a $OUTPUT_LOG
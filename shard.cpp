@@ -0,0 +1,147 @@
+#include "shard.hpp"
+#include <string.h>
+#include <algorithm>
+
+// Spins briefly, then gives up the CPU, until ready() holds
+template <typename Pred>
+static void wait_until(Pred ready) {
+    for (int spins = 0; !ready(); spins++) {
+        if (spins >= 64) std::this_thread::yield();
+    }
+}
+
+// The address bits in both the L1 and the L2 set index, [*shift, *shift +
+// the result)
+static unsigned shared_index_bits(const sim_config_t &config, unsigned *shift) {
+    const cache_config_t &l1 = config.l1_config;
+    const cache_config_t &l2 = config.l2_config;
+    uint64_t low = l1.b;
+    uint64_t high = l1.c - l1.s;
+    if (!l2.disabled) {
+        low = std::max(low, l2.b);
+        high = std::min(high, l2.c - l2.s);
+    }
+    *shift = low;
+    return high > low ? high - low : 0;
+}
+
+unsigned ShardedSimulator::plan(const sim_config_t &config, unsigned max_shards, const char **why) {
+    replacement_policy_t policy = config.l2_config.replace_policy;
+    unsigned shift;
+    unsigned bits = shared_index_bits(config, &shift);
+    if (config.victim_cache_entries > 0) {
+        *why = "the victim cache is shared by every set";
+        return 1;
+    }
+    if (!config.l2_config.disabled
+        && (policy == REPLACEMENT_POLICY_RANDOM || policy == REPLACEMENT_POLICY_BRRIP
+            || policy == REPLACEMENT_POLICY_DRRIP || policy == REPLACEMENT_POLICY_OPT)) {
+        *why = "the L2 policy keeps state across sets";
+        return 1;
+    }
+    if (config.write_buffer.entries > 0) {
+        *why = "the write buffer is shared by every set";
+        return 1;
+    }
+    if (config.prefetch_l1.kind != PREFETCHER_NONE || config.prefetch_l2.kind != PREFETCHER_NONE) {
+        *why = "prefetches cross sets";
+        return 1;
+    }
+    if (!bits) {
+        *why = "L1 and L2 have no set index bits in common";
+        return 1;
+    }
+    return bits >= 32 ? max_shards : std::min<uint64_t>(max_shards, (uint64_t)1 << bits);
+}
+
+ShardedSimulator::ShardedSimulator(const sim_config_t &config, unsigned shards)
+    : shards(new shard_t[shards]), n_shards(shards), stopped(false) {
+    key_bits = shared_index_bits(config, &key_shift);
+    if (key_bits > 32) {
+        // Only the top 32 bits pick the range
+        key_shift += key_bits - 32;
+        key_bits = 32;
+    }
+    for (unsigned i = 0; i < n_shards; i++) {
+        shard_t *shard = &this->shards[i];
+        shard->sim.setup(config);
+        memset(&shard->stats, 0, sizeof shard->stats);
+        shard->slots = new access_batch_t[SHARD_SLOTS];
+        shard->slots[0].count = 0;
+        shard->head = 0;
+        shard->tail = 0;
+        shard->thread = std::thread(&ShardedSimulator::run, this, shard);
+    }
+}
+
+ShardedSimulator::~ShardedSimulator() {
+    stop();
+    for (unsigned i = 0; i < n_shards; i++) {
+        delete[] shards[i].slots;
+    }
+    delete[] shards;
+}
+
+void ShardedSimulator::access_batch(const access_t *accesses, size_t count) {
+    uint64_t key_mask = ((uint64_t)1 << key_bits) - 1;
+    for (size_t i = 0; i < count; i++) {
+        uint64_t key = (accesses[i].addr >> key_shift) & key_mask;
+        shard_t *shard = &shards[(key * n_shards) >> key_bits];
+        access_batch_t *batch = &shard->slots[shard->head.load(std::memory_order_relaxed) % SHARD_SLOTS];
+        batch->records[batch->count++] = accesses[i];
+        if (batch->count == TRACE_BATCH_SIZE) {
+            publish(shard);
+        }
+    }
+}
+
+// Hands the batch being filled to the shard and starts the next one. An
+// empty batch tells the shard to finish.
+void ShardedSimulator::publish(shard_t *shard) {
+    size_t i = shard->head.load(std::memory_order_relaxed);
+    shard->head.store(++i, std::memory_order_release);
+    wait_until([&] { return i - shard->tail.load(std::memory_order_acquire) < SHARD_SLOTS; });
+    shard->slots[i % SHARD_SLOTS].count = 0;
+}
+
+// Shard thread
+void ShardedSimulator::run(shard_t *shard) {
+    for (size_t i = 0;; i++) {
+        wait_until([&] { return shard->head.load(std::memory_order_acquire) != i; });
+        const access_batch_t *batch = &shard->slots[i % SHARD_SLOTS];
+        if (!batch->count) {
+            return;
+        }
+        shard->sim.access_batch(batch->records, batch->count, &shard->stats);
+        shard->tail.store(i + 1, std::memory_order_release);
+    }
+}
+
+void ShardedSimulator::stop() {
+    if (stopped) {
+        return;
+    }
+    stopped = true;
+    for (unsigned i = 0; i < n_shards; i++) {
+        shard_t *shard = &shards[i];
+        if (shard->slots[shard->head.load(std::memory_order_relaxed) % SHARD_SLOTS].count) {
+            publish(shard);
+        }
+        // The end marker
+        publish(shard);
+    }
+    for (unsigned i = 0; i < n_shards; i++) {
+        shards[i].thread.join();
+    }
+}
+
+void ShardedSimulator::finish(sim_stats_t *stats) {
+    stop();
+    for (unsigned i = 0; i < n_shards; i++) {
+        sim_stats_add(stats, &shards[i].stats);
+        if (i > 0) {
+            shards[0].sim.merge_shard(shards[i].sim);
+        }
+    }
+    shards[0].sim.finish(stats);
+}
@@ -0,0 +1,68 @@
+#ifndef SHARD_HPP
+#define SHARD_HPP
+
+#include "simulator.hpp"
+#include "trace_pipeline.hpp"
+#include <atomic>
+#include <thread>
+
+// Batches in flight between the caller and each shard
+static const size_t SHARD_SLOTS = 8;
+
+// Simulates one configuration on several threads for -j. With no victim
+// cache, a block only ever meets the L1 set and the L2 set its address
+// indexes, write-backs included, so the address bits that both set indices
+// share split the sets into groups nothing crosses. Each shard owns a range
+// of those groups with a Simulator of its own, gets its records in trace
+// order through a ring like TracePipeline's, and so ends up with exactly
+// the counts a serial run gives those sets. The shards' counts add up to the
+// serial run's.
+//
+// The victim cache is shared by every L1 set, the write buffer by every
+// L2 set, and RANDOM, BRRIP, DRRIP and OPT carry state from one set to the
+// next in trace order, so plan() turns those down and they run serially.
+class ShardedSimulator {
+public:
+    // How many shards, at most max_shards, config splits into. 1 when it
+    // cannot be split, with *why set to the reason.
+    static unsigned plan(const sim_config_t &config, unsigned max_shards, const char **why);
+
+    // Starts a thread per shard
+    ShardedSimulator(const sim_config_t &config, unsigned shards);
+    ~ShardedSimulator();
+
+    // Same as sim_access_batch() on a serial simulator
+    void access_batch(const access_t *accesses, size_t count);
+    // Waits for the shards to catch up, then sums their statistics into
+    // stats and finishes them like sim_finish(). Call once, at the end.
+    void finish(sim_stats_t *stats);
+
+private:
+    typedef struct shard {
+        Simulator sim;
+        sim_stats_t stats;
+        access_batch_t *slots;
+        // Batches published by the caller and released by the shard, as in
+        // TracePipeline. Slot head % SHARD_SLOTS is being filled.
+        std::atomic<size_t> head;
+        std::atomic<size_t> tail;
+        std::thread thread;
+    } shard_t;
+
+    ShardedSimulator(const ShardedSimulator &);
+    ShardedSimulator &operator=(const ShardedSimulator &);
+
+    void publish(shard_t *shard);
+    void run(shard_t *shard);
+    void stop();
+
+    shard_t *shards;
+    unsigned n_shards;
+    bool stopped;
+    // The shared index bits are addr >> key_shift masked to key_bits. At
+    // most the top 32 of them pick the shard, by range.
+    unsigned key_shift;
+    unsigned key_bits;
+};
+
+#endif /* SHARD_HPP */
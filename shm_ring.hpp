@@ -0,0 +1,174 @@
+#ifndef SHM_RING_HPP
+#define SHM_RING_HPP
+
+// Shared-memory trace ring, for feeding cachesim --shm NAME straight from an
+// instrumented program. This header is all a producer needs:
+//
+//   ShmRingProducer ring;
+//   if (ring.open("myapp")) { ...error... }
+//   ring.access('R', addr);      // or ring.load(addr) / ring.store(addr)
+//   ...
+//   ring.close();                // flushes, then tells cachesim it is over
+//
+// The producer creates the POSIX shared memory object /NAME; cachesim waits
+// for it to appear, so either side may start first. Records are single
+// uint64 words laid out like TRACE_ENCODING_FIXED: the address in bits 0-62
+// and bit 63 set for a write.
+//
+// Layout: a shm_ring_t header, then capacity records. The producer owns
+// head and the consumer owns tail, both counts of records that only grow;
+// record i lives at records[i % capacity]. Each side publishes its index with
+// a release store and reads the other's with an acquire load, so there are
+// no locks. A full ring holds the producer up until cachesim catches up.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <atomic>
+#include <thread>
+
+static const char SHM_RING_MAGIC[8] = {'C', 'S', 'I', 'M', 'S', 'H', 'M', '\0'};
+static const uint32_t SHM_RING_VERSION = 1;
+// Records, 8 MiB of them
+static const uint64_t SHM_RING_DEFAULT_CAPACITY = 1 << 20;
+// The producer publishes head at least this often, in records
+static const uint64_t SHM_RING_PUBLISH = 1024;
+static const uint64_t SHM_RING_WRITE = (uint64_t)1 << 63;
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2 && ATOMIC_INT_LOCK_FREE == 2, "shared memory atomics must be lock-free");
+
+typedef struct shm_ring {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    // Records the ring holds, a power of two
+    uint64_t capacity;
+    // So the consumer can tell a producer that died from a slow one
+    int64_t producer_pid;
+    // Set by the producer once the fields above are filled in
+    std::atomic<uint32_t> ready;
+    // Set by the producer after publishing its last record
+    std::atomic<uint32_t> closed;
+    // Each index on a cache line of its own
+    alignas(64) std::atomic<uint64_t> head;
+    alignas(64) std::atomic<uint64_t> tail;
+} shm_ring_t;
+
+// Bytes from the start of the object to records[0]
+static const size_t SHM_RING_RECORDS_OFFSET = (sizeof(shm_ring_t) + 63) / 64 * 64;
+
+static inline uint64_t *shm_ring_records(shm_ring_t *ring) {
+    return (uint64_t *)((char *)ring + SHM_RING_RECORDS_OFFSET);
+}
+
+static inline size_t shm_ring_size(uint64_t capacity) {
+    return SHM_RING_RECORDS_OFFSET + capacity * sizeof(uint64_t);
+}
+
+// shm_open() wants "/NAME"; NAME alone is accepted too. Returns nonzero when
+// it does not fit in size bytes.
+static inline int shm_ring_path(const char *name, char *path, size_t size) {
+    return snprintf(path, size, "%s%s", name[0] == '/' ? "" : "/", name) >= (int)size;
+}
+
+class ShmRingProducer {
+public:
+    ShmRingProducer() : ring(NULL), records(NULL), head(0), published(0), tail(0), mask(0) { }
+    ~ShmRingProducer() { close(); }
+
+    // Creates the ring /NAME, replacing any stale one, for capacity records
+    // (a power of two). Returns nonzero and prints a message on failure.
+    int open(const char *name, uint64_t capacity = SHM_RING_DEFAULT_CAPACITY) {
+        char path[256];
+        if (!capacity || (capacity & (capacity - 1)) || shm_ring_path(name, path, sizeof path)) {
+            fprintf(stderr, "Bad shared memory ring `%s' of %llu records\n", name, (unsigned long long)capacity);
+            return 1;
+        }
+        shm_unlink(path);
+        int fd = shm_open(path, O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd < 0) {
+            fprintf(stderr, "Could not create shared memory ring `%s'\n", path);
+            return 1;
+        }
+        size_t size = shm_ring_size(capacity);
+        void *map = ftruncate(fd, size) ? MAP_FAILED : mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (map == MAP_FAILED) {
+            fprintf(stderr, "Could not map shared memory ring `%s'\n", path);
+            shm_unlink(path);
+            return 1;
+        }
+        // ftruncate() zeroed everything, the indices and flags included
+        ring = (shm_ring_t *)map;
+        memcpy(ring->magic, SHM_RING_MAGIC, sizeof ring->magic);
+        ring->version = SHM_RING_VERSION;
+        ring->capacity = capacity;
+        ring->producer_pid = getpid();
+        ring->ready.store(1, std::memory_order_release);
+        records = shm_ring_records(ring);
+        head = published = tail = 0;
+        mask = capacity - 1;
+        return 0;
+    }
+
+    void load(uint64_t addr) { push(addr); }
+    void store(uint64_t addr) { push(addr | SHM_RING_WRITE); }
+    // rw is 'R' or 'W', as in a text trace
+    void access(char rw, uint64_t addr) { push(addr | (rw == 'W' ? SHM_RING_WRITE : 0)); }
+
+    // Makes everything pushed so far visible to cachesim
+    void flush() {
+        if (ring && published != head) {
+            ring->head.store(head, std::memory_order_release);
+            published = head;
+        }
+    }
+
+    // Flushes and marks the end of the trace. The object's name was already
+    // removed by cachesim, or is left for the next open() to replace.
+    void close() {
+        if (!ring) {
+            return;
+        }
+        flush();
+        ring->closed.store(1, std::memory_order_release);
+        munmap(ring, shm_ring_size(ring->capacity));
+        ring = NULL;
+    }
+
+private:
+    ShmRingProducer(const ShmRingProducer &);
+    ShmRingProducer &operator=(const ShmRingProducer &);
+
+    void push(uint64_t word) {
+        if (head - tail > mask) {
+            wait_for_room();
+        }
+        records[head & mask] = word;
+        if (++head - published >= SHM_RING_PUBLISH) {
+            flush();
+        }
+    }
+
+    // Back-pressure: publish what is there and wait for cachesim to make
+    // room
+    void wait_for_room() {
+        flush();
+        for (int spins = 0; head - (tail = ring->tail.load(std::memory_order_acquire)) > mask; spins++) {
+            if (spins >= 64) std::this_thread::yield();
+        }
+    }
+
+    shm_ring_t *ring;
+    uint64_t *records;
+    // Records pushed, records published, and the last tail seen
+    uint64_t head;
+    uint64_t published;
+    uint64_t tail;
+    uint64_t mask;
+};
+
+#endif /* SHM_RING_HPP */
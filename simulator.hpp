@@ -0,0 +1,735 @@
+#ifndef SIMULATOR_HPP
+#define SIMULATOR_HPP
+
+#include "cachesim.hpp"
+#include "trace.hpp"
+#include "tag_lookup.hpp"
+#include "profile.hpp"
+#include "replacement.hpp"
+#include "opt.hpp"
+#include "prefetch.hpp"
+#include <cstddef>
+#include <vector>
+
+// Block state bits kept next to each tag
+static const uint8_t BLOCK_VALID = 1;
+static const uint8_t BLOCK_DIRTY = 2;
+// Filled by a prefetch and not yet used
+static const uint8_t BLOCK_PREFETCHED = 4;
+
+// Recency ranks of one set of n ways, shared by both level layouts. The
+// updates run in fixed groups of eight ways so the compiler can turn them
+// into vector compares.
+static inline int rank_find(const uint16_t *rk, int n, int rank) {
+    for (int w = 0; w < n; w++) {
+        if (rk[w] == rank) return w;
+    }
+    return -1;
+}
+
+static inline void rank_to_front(uint16_t *rk, int n, int way) {
+    uint16_t r = rk[way];
+    int w = 0;
+    for (; w + 8 <= n; w += 8) {
+        for (int k = 0; k < 8; k++) rk[w + k] += rk[w + k] < r;
+    }
+    for (; w < n; w++) rk[w] += rk[w] < r;
+    rk[way] = 0;
+}
+
+static inline void rank_to_back(uint16_t *rk, int n, int way, uint16_t back) {
+    uint16_t r = rk[way];
+    int w = 0;
+    for (; w + 8 <= n; w += 8) {
+        for (int k = 0; k < 8; k++) rk[w + k] -= rk[w + k] > r && rk[w + k] <= back;
+    }
+    for (; w < n; w++) rk[w] -= rk[w] > r && rk[w] <= back;
+    rk[way] = back;
+}
+
+// One cache level with flat set storage: way w of set i lives at slot
+// (i << s) + w of the tag and state arrays, so a level is a handful of
+// contiguous arrays rather than one heap vector per set. Recency is a rank per
+// way, 0 being the front (MRU) of the set's list and live-1 its back, so hits
+// and fills only rewrite ranks in place and tags never move.
+//
+// Blocks are never invalidated, so a set fills its ways in index order and
+// ways [used, live) are the empty ones. live is below the associativity only
+// for L1 sets that lost ways, see l1_promote().
+//
+// Methods that walk a set take the associativity as an optional template
+// argument. The specialized access kernels pass it when it is known at setup
+// so the loops unroll; 0 reads it from ways.
+struct CacheLevel {
+    uint64_t s;
+    int ways;
+    std::vector<uint64_t> tags;
+    std::vector<uint8_t> flags;
+    std::vector<uint16_t> ranks;
+    std::vector<uint32_t> used;
+    std::vector<uint32_t> live;
+    // Tag search for sets this wide, picked for the CPU by allocate()
+    tag_find_fn find;
+    // Bit-packed replacement state, policy_words per set, see replacement.hpp
+    std::vector<uint64_t> policy_bits;
+    uint64_t policy_words;
+
+    void init(uint64_t index_bits, uint64_t assoc_bits) {
+        allocate((uint64_t)1 << index_bits, assoc_bits, (uint64_t)1 << assoc_bits);
+    }
+
+    void allocate(uint64_t sets, uint64_t assoc_bits, uint64_t n_ways) {
+        s = assoc_bits;
+        ways = n_ways;
+        uint64_t slots = sets * n_ways;
+        tags.assign(slots, 0);
+        flags.assign(slots, 0);
+        ranks.resize(slots);
+        for (uint64_t i = 0; i < slots; i++) {
+            ranks[i] = i % n_ways;
+        }
+        used.assign(sets, 0);
+        live.assign(sets, n_ways);
+        find = tag_find_select(n_ways);
+        init_policy(0);
+    }
+
+    void init_policy(uint64_t words) {
+        policy_words = words;
+        policy_bits.assign(used.size() * words, 0);
+    }
+
+    uint64_t *policy_state(uint64_t set) { return &policy_bits[set * policy_words]; }
+
+    template <int WAYS = 0>
+    uint64_t base(uint64_t set) const { return WAYS ? set * WAYS : set << s; }
+
+    // Every set is allocated up front, so a set index is its own slot
+    uint64_t touch_set(uint64_t index) const { return index; }
+
+    uint64_t tag(uint64_t set, int way) const { return tags[base(set) + way]; }
+
+    // Way holding a valid block with this tag, or -1
+    template <int WAYS = 0>
+    int lookup(uint64_t set, uint64_t tag) const {
+        const uint64_t *t = &tags[base<WAYS>(set)];
+        if ((WAYS ? WAYS : ways) < TAG_FIND_MIN_SIMD_WAYS) {
+            return tag_find_scalar(t, used[set], tag);
+        }
+        return find(t, used[set], tag);
+    }
+
+    // Front-most way whose tag field matches, valid or not. Write-backs probe
+    // L2 this way, and empty ways carry tag 0, so for tag 0 an empty way
+    // ahead of the valid match wins.
+    int first_match(uint64_t set, uint64_t tag) const {
+        int found = lookup(set, tag);
+        if (tag != 0 || used[set] == live[set]) return found;
+        const uint16_t *rk = &ranks[base(set)];
+        for (uint32_t w = used[set]; w < live[set]; w++) {
+            if (found == -1 || rk[w] < rk[found]) found = w;
+        }
+        return found;
+    }
+
+    // An empty way, or -1 when the set is full. Empty ways are
+    // indistinguishable, so taking the lowest one does not affect the outcome.
+    int free_way(uint64_t set) const {
+        return used[set] < live[set] ? used[set] : -1;
+    }
+
+    // Way at the given position of the set's list
+    template <int WAYS = 0>
+    int way_at(uint64_t set, int rank) const {
+        return rank_find(&ranks[base<WAYS>(set)], WAYS ? WAYS : ways, rank);
+    }
+
+    template <int WAYS = 0>
+    int back_way(uint64_t set) const {
+        if (WAYS == 1) return 0;
+        return way_at<WAYS>(set, live[set] - 1);
+    }
+
+    template <int WAYS = 0>
+    void to_front(uint64_t set, int way) {
+        rank_to_front(&ranks[base<WAYS>(set)], WAYS ? WAYS : ways, way);
+    }
+
+    template <int WAYS = 0>
+    void to_back(uint64_t set, int way) {
+        rank_to_back(&ranks[base<WAYS>(set)], WAYS ? WAYS : ways, way, live[set] - 1);
+    }
+
+    template <int WAYS = 0>
+    bool dirty(uint64_t set, int way) const {
+        return flags[base<WAYS>(set) + way] & BLOCK_DIRTY;
+    }
+
+    void set_dirty(uint64_t set, int way) {
+        flags[base(set) + way] |= BLOCK_DIRTY;
+    }
+
+    template <int WAYS = 0>
+    bool prefetched(uint64_t set, int way) const {
+        return flags[base<WAYS>(set) + way] & BLOCK_PREFETCHED;
+    }
+
+    void clear_prefetched(uint64_t set, int way) {
+        flags[base(set) + way] &= ~BLOCK_PREFETCHED;
+    }
+
+    template <int WAYS = 0>
+    void fill(uint64_t set, int way, uint64_t tag, bool dirty, bool prefetched = false) {
+        if ((uint32_t)way == used[set]) used[set]++;
+        tags[base<WAYS>(set) + way] = tag;
+        flags[base<WAYS>(set) + way] = BLOCK_VALID | (dirty ? BLOCK_DIRTY : 0) | (prefetched ? BLOCK_PREFETCHED : 0);
+    }
+};
+
+// The victim cache: a single fully associative set of any size, keyed by L1
+// block address. A chained hash finds blocks and an intrusive doubly linked
+// list keeps them in recency order, front (MRU) to back, so lookup, promotion
+// and eviction cost the same at 2 entries or 256. Entries are never
+// invalidated, so [0, used) are the valid ones.
+struct VictimCache {
+    int entries;
+    uint32_t used;
+    std::vector<uint64_t> blocks;
+    std::vector<uint8_t> flags;
+    // Recency list links, -1 past either end
+    std::vector<int32_t> prev;
+    std::vector<int32_t> next;
+    int32_t front;
+    int32_t back;
+    // Hash chains: the first entry of each bucket, and each entry's successor
+    std::vector<int32_t> buckets;
+    std::vector<int32_t> chain;
+    int bucket_bits;
+
+    void init(uint64_t n_entries) {
+        entries = n_entries;
+        used = 0;
+        blocks.assign(entries, 0);
+        flags.assign(entries, 0);
+        prev.assign(entries, -1);
+        next.assign(entries, -1);
+        front = back = -1;
+        // At least two buckets per entry keeps the chains short
+        bucket_bits = 1;
+        while (((uint64_t)1 << bucket_bits) < 2 * n_entries) bucket_bits++;
+        buckets.assign((size_t)1 << bucket_bits, -1);
+        chain.assign(entries, -1);
+    }
+
+    uint64_t bucket(uint64_t block) const {
+        return (block * 0x9e3779b97f4a7c15ULL) >> (64 - bucket_bits);
+    }
+
+    // Entry holding this block, or -1
+    int lookup(uint64_t block) const {
+        for (int32_t e = buckets[bucket(block)]; e != -1; e = chain[e]) {
+            if (blocks[e] == block) return e;
+        }
+        return -1;
+    }
+
+    int free_way() const {
+        return used < (uint32_t)entries ? used : -1;
+    }
+
+    int back_way() const { return back; }
+
+    uint64_t block(int way) const { return blocks[way]; }
+
+    bool dirty(int way) const { return flags[way] & BLOCK_DIRTY; }
+
+    // Puts a block in an entry, which must be valid or free_way(). A newly
+    // valid entry joins the list at the front.
+    void fill(int way, uint64_t block, bool dirty) {
+        if ((uint32_t)way == used) {
+            used++;
+            link_front(way);
+        }
+        else {
+            unhash(way);
+        }
+        blocks[way] = block;
+        flags[way] = BLOCK_VALID | (dirty ? BLOCK_DIRTY : 0);
+        int32_t &head = buckets[bucket(block)];
+        chain[way] = head;
+        head = way;
+    }
+
+    void to_front(int way) {
+        if (way == front) return;
+        unlink(way);
+        link_front(way);
+    }
+
+    void link_front(int way) {
+        prev[way] = -1;
+        next[way] = front;
+        if (front != -1) prev[front] = way;
+        else back = way;
+        front = way;
+    }
+
+    void unlink(int way) {
+        if (prev[way] != -1) next[prev[way]] = next[way];
+        else front = next[way];
+        if (next[way] != -1) prev[next[way]] = prev[way];
+        else back = prev[way];
+    }
+
+    void unhash(int way) {
+        int32_t *link = &buckets[bucket(blocks[way])];
+        while (*link != way) link = &chain[*link];
+        *link = chain[way];
+    }
+};
+
+// A cache level for very large last-level caches, with the same interface as
+// CacheLevel over slots rather than set indices. Sets are materialized on
+// first touch: touch_set() looks the set index up in an open-addressed table
+// (linear probing, at most half full) and appends storage for a new slot when
+// it is missing, so setup is O(1) and memory follows the sets the trace
+// reaches rather than the nominal capacity.
+//
+// Each way is packed into entry_bits = tag width + 2 bits of a bit stream,
+// the tag above the BLOCK_VALID and BLOCK_DIRTY bits. Tags cost only the
+// address bits above the index and block offset instead of a full word.
+struct SparseCacheLevel {
+    uint64_t s;
+    int ways;
+    int entry_bits;
+    uint64_t entry_mask;
+    // Set index of each materialized slot, in order of first touch
+    std::vector<uint64_t> keys;
+    // entry_bits per way, slot-major, plus a word of padding so an entry can
+    // always be read as two words
+    std::vector<uint64_t> packed;
+    std::vector<uint16_t> ranks;
+    std::vector<uint32_t> used;
+    std::vector<uint64_t> policy_bits;
+    uint64_t policy_words;
+    // Slot + 1 of each set index hashed here, 0 when empty
+    std::vector<uint32_t> table;
+    int table_bits;
+
+    void init(uint64_t tag_bits, uint64_t assoc_bits, uint64_t words) {
+        s = assoc_bits;
+        ways = (uint64_t)1 << assoc_bits;
+        policy_words = words;
+        entry_bits = tag_bits + 2;
+        entry_mask = entry_bits == 64 ? ~(uint64_t)0 : ((uint64_t)1 << entry_bits) - 1;
+        clear();
+    }
+
+    // Drops every set
+    void clear() {
+        keys.clear();
+        packed.assign(1, 0);
+        ranks.clear();
+        used.clear();
+        policy_bits.clear();
+        table_bits = 10;
+        table.assign((size_t)1 << table_bits, 0);
+    }
+
+    uint64_t sets() const { return keys.size(); }
+
+    uint64_t bucket(uint64_t index) const {
+        return (index * 0x9e3779b97f4a7c15ULL) >> (64 - table_bits);
+    }
+
+    // Slot of a set index, materializing the set empty on first touch
+    uint64_t touch_set(uint64_t index) {
+        uint64_t mask = table.size() - 1;
+        uint64_t h = bucket(index);
+        for (; table[h]; h = (h + 1) & mask) {
+            if (keys[table[h] - 1] == index) return table[h] - 1;
+        }
+        uint64_t slot = keys.size();
+        table[h] = slot + 1;
+        materialize(index);
+        if (2 * keys.size() > table.size()) {
+            rehash(table_bits + 1);
+        }
+        return slot;
+    }
+
+    // Appends an empty set, ranked the way CacheLevel starts its sets
+    void materialize(uint64_t index) {
+        keys.push_back(index);
+        used.push_back(0);
+        for (int w = 0; w < ways; w++) {
+            ranks.push_back(w);
+        }
+        packed.resize(((keys.size() << s) * entry_bits + 63) / 64 + 1, 0);
+        policy_bits.resize(keys.size() * policy_words, 0);
+    }
+
+    uint64_t *policy_state(uint64_t set) { return &policy_bits[set * policy_words]; }
+
+    void rehash(int bits) {
+        table_bits = bits;
+        table.assign((size_t)1 << table_bits, 0);
+        uint64_t mask = table.size() - 1;
+        for (uint64_t slot = 0; slot < keys.size(); slot++) {
+            uint64_t h = bucket(keys[slot]);
+            while (table[h]) h = (h + 1) & mask;
+            table[h] = slot + 1;
+        }
+    }
+
+    uint64_t entry(uint64_t set, int way) const {
+        uint64_t bit = ((set << s) + way) * entry_bits;
+        const uint64_t *p = &packed[bit / 64];
+        unsigned offset = bit % 64;
+        uint64_t value = p[0] >> offset;
+        if (offset + entry_bits > 64) value |= p[1] << (64 - offset);
+        return value & entry_mask;
+    }
+
+    void set_entry(uint64_t set, int way, uint64_t value) {
+        uint64_t bit = ((set << s) + way) * entry_bits;
+        uint64_t *p = &packed[bit / 64];
+        unsigned offset = bit % 64;
+        p[0] = (p[0] & ~(entry_mask << offset)) | (value << offset);
+        if (offset + entry_bits > 64) {
+            unsigned spill = 64 - offset;
+            p[1] = (p[1] & ~(entry_mask >> spill)) | (value >> spill);
+        }
+    }
+
+    uint64_t tag(uint64_t set, int way) const { return entry(set, way) >> 2; }
+
+    int lookup(uint64_t set, uint64_t tag) const {
+        for (uint32_t w = 0; w < used[set]; w++) {
+            if (entry(set, w) >> 2 == tag) return w;
+        }
+        return -1;
+    }
+
+    // Same tag-0 rule as CacheLevel::first_match()
+    int first_match(uint64_t set, uint64_t tag) const {
+        int found = lookup(set, tag);
+        if (tag != 0 || used[set] == (uint32_t)ways) return found;
+        const uint16_t *rk = &ranks[set << s];
+        for (int w = used[set]; w < ways; w++) {
+            if (found == -1 || rk[w] < rk[found]) found = w;
+        }
+        return found;
+    }
+
+    int free_way(uint64_t set) const {
+        return used[set] < (uint32_t)ways ? used[set] : -1;
+    }
+
+    int way_at(uint64_t set, int rank) const {
+        return rank_find(&ranks[set << s], ways, rank);
+    }
+
+    void to_front(uint64_t set, int way) {
+        rank_to_front(&ranks[set << s], ways, way);
+    }
+
+    void to_back(uint64_t set, int way) {
+        rank_to_back(&ranks[set << s], ways, way, ways - 1);
+    }
+
+    bool dirty(uint64_t set, int way) const {
+        return entry(set, way) & BLOCK_DIRTY;
+    }
+
+    void set_dirty(uint64_t set, int way) {
+        set_entry(set, way, entry(set, way) | BLOCK_DIRTY);
+    }
+
+    // The packed entries have no room for BLOCK_PREFETCHED, so a sparse L2
+    // does not prefetch
+    bool prefetched(uint64_t, int) const { return false; }
+    void clear_prefetched(uint64_t, int) { }
+
+    void fill(uint64_t set, int way, uint64_t tag, bool dirty, bool = false) {
+        if ((uint32_t)way == used[set]) used[set]++;
+        set_entry(set, way, tag << 2 | BLOCK_VALID | (dirty ? BLOCK_DIRTY : 0));
+    }
+};
+
+// The coalescing write buffer in front of DRAM: a FIFO of up to
+// blocks.size() block addresses that retires its oldest entry every
+// drain_cycles while it is not empty, so the entry at head finishes at
+// next_drain. Nothing happens between writes; each one first retires
+// whatever finished before it arrived.
+struct WriteBuffer {
+    std::vector<uint64_t> blocks;
+    uint32_t head;
+    uint32_t count;
+    double drain_cycles;
+    double next_drain;
+    bool merge;
+
+    void init(uint64_t entries, double drain_cycles, bool merge) {
+        blocks.assign(entries, 0);
+        head = 0;
+        count = 0;
+        this->drain_cycles = drain_cycles;
+        next_drain = 0;
+        this->merge = merge;
+    }
+
+    void retire(double now) {
+        while (count && next_drain <= now) {
+            head = head + 1 == blocks.size() ? 0 : head + 1;
+            count--;
+            next_drain += drain_cycles;
+        }
+    }
+
+    bool holds(uint64_t block) const {
+        for (uint32_t i = 0, slot = head; i < count; i++, slot = slot + 1 == blocks.size() ? 0 : slot + 1) {
+            if (blocks[slot] == block) return true;
+        }
+        return false;
+    }
+
+    // Queues a write of block arriving at cycle now, which never goes back.
+    // Returns the cycles the writer waits for a free entry, or -1 when the
+    // write merged into one already queued.
+    double write(uint64_t block, double now) {
+        retire(now);
+        if (merge && holds(block)) {
+            return -1;
+        }
+        double stall = 0;
+        if (count == blocks.size()) {
+            stall = next_drain - now;
+            retire(next_drain);
+        }
+        if (!count) {
+            next_drain = now + stall + drain_cycles;
+        }
+        uint64_t tail = head + count;
+        blocks[tail < blocks.size() ? tail : tail - blocks.size()] = block;
+        count++;
+        return stall;
+    }
+};
+
+// Fields of the geometry a checkpoint must match, see checkpoint.cpp
+static const int CHECKPOINT_GEOMETRY = 11;
+
+// How the access kernels reach L2
+typedef enum l2_storage {
+    L2_NONE,
+    // CacheLevel, every set allocated by setup()
+    L2_FLAT,
+    // SparseCacheLevel, for cache_config_t::sparse
+    L2_SPARSE,
+} l2_storage_t;
+
+// One complete L1 / victim cache / L2 hierarchy. All simulator state,
+// including the RANDOM replacement generator, lives in the object, so any
+// number of simulators can run side by side, one per thread.
+class Simulator {
+public:
+    // rng_state lets a simulator share its generator state with the
+    // evict_random()/evict_srand() C API; by default it has its own.
+    explicit Simulator(unsigned long *rng_state = NULL);
+
+    void setup(const sim_config_t &config);
+    void access(char rw, uint64_t addr, sim_stats_t *stats);
+    void access_batch(const access_t *accesses, size_t count, sim_stats_t *stats);
+    // Same as access_batch() with the statistics thrown away
+    void warm_batch(const access_t *accesses, size_t count);
+    void finish(sim_stats_t *stats);
+    // Adds in what finish() needs beyond the statistics from a simulator of
+    // the same configuration that ran a disjoint group of sets, see shard.hpp
+    void merge_shard(const Simulator &shard);
+
+    // Appends every event that reaches L2 to stream as it happens: a READ
+    // with the full address for each L2 read, and a WRITE with the block's
+    // address for each write-back. The stream depends only on the L1 and
+    // victim cache configuration, so it can stand in for the trace when
+    // only L2 parameters change. NULL stops recording.
+    void record_l2_stream(trace_buffer_t *stream);
+    // Whether the stream ran out of memory, which stops the recording and
+    // leaves the stream short
+    bool l2_stream_failed() const { return l2_stream_lost; }
+    // Replays one recorded event against L2 alone. The L1-side counters are
+    // not touched; start from the stats of the recording run with the L2
+    // read hit and miss counts cleared.
+    void access_l2(char rw, uint64_t addr, sim_stats_t *stats);
+
+    // Time and events per phase since setup(). All zero unless built with
+    // PROFILE.
+    const sim_profile_t &profile() const { return m_profile; }
+
+    // Writes the cache contents, recency and RANDOM generator state to
+    // path, along with how many trace records produced them. Loading needs
+    // a simulator set up with the same geometry (sizes, block size and
+    // associativity, victim cache entries, L2 enabled); statistics are not
+    // saved. Both print a message and return nonzero on failure; see
+    // checkpoint.cpp for the format.
+    int save_checkpoint(const char *path, uint64_t trace_offset) const;
+    int load_checkpoint(const char *path, uint64_t *trace_offset);
+
+    // First pass for REPLACEMENT_POLICY_OPT, after setup(): reads trace to
+    // the end to find every L2 read's next use. Simulate the same trace from
+    // its start afterwards. Returns nonzero on failure.
+    int plan_opt(trace_file_t *trace) { return next_use.build(m_config, trace); }
+
+    // Same generator as evict_random()/evict_srand()
+    int evict_random();
+    void evict_srand(unsigned int seed);
+
+private:
+    // Each configuration runs an access path specialized on the L2 policy,
+    // whether there is a victim cache, whether and how L2 is stored, and (up
+    // to 8 ways) the L1 associativity, so the per-access code has no
+    // configuration branches. setup() picks the instantiations.
+    typedef void (Simulator::*access_fn_t)(char rw, uint64_t addr, sim_stats_t *stats);
+    typedef void (Simulator::*access_batch_fn_t)(const access_t *accesses, size_t count, sim_stats_t *stats);
+    typedef void (Simulator::*l2_read_fn_t)(uint64_t addr, sim_stats_t *stats);
+    typedef void (Simulator::*l2_write_back_fn_t)(uint64_t block_addr, sim_stats_t *stats);
+
+    template <replacement_policy_t POLICY, bool VICTIM, l2_storage_t L2, int L1_WAYS>
+    void access_kernel(char rw, uint64_t addr, sim_stats_t *stats);
+    template <replacement_policy_t POLICY, bool VICTIM, l2_storage_t L2, int L1_WAYS>
+    void access_batch_kernel(const access_t *accesses, size_t count, sim_stats_t *stats);
+    template <replacement_policy_t POLICY, l2_storage_t L2>
+    void l2_read(uint64_t addr, sim_stats_t *stats);
+    template <replacement_policy_t POLICY, l2_storage_t L2>
+    void l1_write_back(uint64_t block_addr, sim_stats_t *stats);
+    // Appends an event to the recorded L2 stream
+    void record_l2(char rw, uint64_t addr);
+    template <replacement_policy_t POLICY, l2_storage_t L2>
+    void l1_write_through(uint64_t block_addr, sim_stats_t *stats);
+    template <replacement_policy_t POLICY, l2_storage_t L2>
+    void l2_write_back(uint64_t block_addr, sim_stats_t *stats);
+    template <replacement_policy_t POLICY, typename LEVEL>
+    void l2_read_level(LEVEL &cache, uint64_t addr, sim_stats_t *stats);
+    template <replacement_policy_t POLICY, typename LEVEL>
+    void l2_write_back_level(LEVEL &cache, uint64_t block_addr, sim_stats_t *stats);
+    template <replacement_policy_t POLICY, typename LEVEL>
+    void l2_touch(LEVEL &cache, uint64_t set, int way, uint64_t next_use_at);
+    template <replacement_policy_t POLICY, typename LEVEL>
+    void l2_fill(LEVEL &cache, uint64_t set, uint64_t index, uint64_t tag, bool dirty,
+                 uint64_t next_use_at, sim_stats_t *stats, bool prefetched = false);
+    template <replacement_policy_t POLICY, bool VICTIM, l2_storage_t L2, int L1_WAYS>
+    void l1_fill(uint64_t l1_index, uint64_t l1_tag, bool dirty, bool prefetched, sim_stats_t *stats);
+    template <replacement_policy_t POLICY, bool VICTIM, l2_storage_t L2, int L1_WAYS>
+    void l1_prefetch(uint64_t block_addr, sim_stats_t *stats);
+    template <replacement_policy_t POLICY, typename LEVEL>
+    void l2_prefetch(LEVEL &cache, uint64_t block_addr, sim_stats_t *stats);
+    void prefetch_used(PrefetchTracker &tracker, uint64_t block_addr, uint64_t *useful, uint64_t *late,
+                       sim_stats_t *stats);
+    void prefetch_evicted(PrefetchTracker &tracker, uint64_t block_addr, bool was_prefetched,
+                          bool by_prefetch, uint64_t *unused);
+    void dram_write(uint64_t block_addr, sim_stats_t *stats);
+    double cycles(const sim_stats_t *stats) const;
+    template <replacement_policy_t POLICY>
+    unsigned rrip_insertion(uint64_t index);
+    template <int WAYS>
+    void l1_promote(uint64_t set, int way);
+    void checkpoint_geometry(uint64_t geometry[CHECKPOINT_GEOMETRY]) const;
+
+    template <replacement_policy_t POLICY, bool VICTIM, l2_storage_t L2, int L1_WAYS>
+    void use_kernels();
+    template <replacement_policy_t POLICY, bool VICTIM, l2_storage_t L2>
+    void select_l1_ways();
+    template <replacement_policy_t POLICY, l2_storage_t L2>
+    void select_kernels();
+    template <l2_storage_t L2>
+    void select_policy();
+
+    access_fn_t access_fn;
+    access_batch_fn_t access_batch_fn;
+    l2_read_fn_t l2_read_fn;
+    l2_write_back_fn_t l2_write_back_fn;
+
+    CacheLevel L1_cache;
+    VictimCache victim_cache;
+    CacheLevel L2_cache;
+    // Takes L2_cache's place when the L2 is sparse
+    SparseCacheLevel sparse_L2_cache;
+    sim_config_t m_config;
+
+    // Address fields, derived from m_config by setup()
+    uint64_t l1_block_offset_bits;
+    uint64_t l1_index_bits;
+    uint64_t l1_index_mask;
+    uint64_t l2_block_offset_bits;
+    uint64_t l2_index_bits;
+    uint64_t l2_index_mask;
+    uint64_t l2_offset_mask;
+
+    uint64_t early_restart_offset_sum;
+    uint64_t early_restart_offset_count;
+
+    // Write strategies other than the usual WBWA L1 and WTWNA L2, and the
+    // buffer between the last level and DRAM
+    bool l1_writes_through;
+    bool l2_writes_back;
+    WriteBuffer write_buffer;
+    // Hit and DRAM read times, for the clock cycles() keeps
+    double hit_time_l1;
+    double hit_time_l2;
+    double dram_time;
+
+    // DRRIP policy selector and BRRIP's count of insertions, see
+    // replacement.hpp
+    uint32_t drrip_psel;
+    uint32_t brrip_insertions;
+    // Where OPT learns the future, see plan_opt()
+    NextUseIndex next_use;
+
+    // Prefetch engines and the blocks they brought in, see prefetch.hpp.
+    // l1_prefetch_read is set while an L1 prefetch reads L2, which is not
+    // a demand access there.
+    Prefetcher l1_prefetcher;
+    Prefetcher l2_prefetcher;
+    PrefetchTracker l1_prefetches;
+    PrefetchTracker l2_prefetches;
+    bool l1_prefetch_read;
+
+    unsigned long own_rng_state;
+    unsigned long *rng_state;
+
+    trace_buffer_t *l2_stream;
+    bool l2_stream_lost;
+
+    // Phase boundaries, see profile.hpp. profile_lap() ends a phase and
+    // counts it; profile_split() charges the time so far to a phase that
+    // carries on afterwards.
+    void profile_begin() {
+#ifdef PROFILE
+        profile_mark = profile_ticks();
+#endif
+    }
+    void profile_split(profile_phase_t phase) {
+#ifdef PROFILE
+        uint64_t now = profile_ticks();
+        m_profile.ticks[phase] += now - profile_mark;
+        profile_mark = now;
+#else
+        (void)phase;
+#endif
+    }
+    void profile_lap(profile_phase_t phase) {
+#ifdef PROFILE
+        profile_split(phase);
+        m_profile.events[phase]++;
+#else
+        (void)phase;
+#endif
+    }
+
+    sim_profile_t m_profile;
+#ifdef PROFILE
+    uint64_t profile_mark;
+#endif
+};
+
+#endif /* SIMULATOR_HPP */
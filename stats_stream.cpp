@@ -0,0 +1,160 @@
+#include "stats_stream.hpp"
+#include <inttypes.h>
+#include <math.h>
+#include <string.h>
+#include <chrono>
+
+// The columns, in order: counts, then the derived values
+static const struct {
+    const char *name;
+    uint64_t sim_stats_t::*count;
+} STATS_COUNTS[] = {
+    {"accesses", &sim_stats_t::accesses_l1},
+    {"reads", &sim_stats_t::reads},
+    {"writes", &sim_stats_t::writes},
+    {"hits_l1", &sim_stats_t::hits_l1},
+    {"misses_l1", &sim_stats_t::misses_l1},
+    {"hits_victim_cache", &sim_stats_t::hits_victim_cache},
+    {"misses_victim_cache", &sim_stats_t::misses_victim_cache},
+    {"reads_l2", &sim_stats_t::reads_l2},
+    {"read_hits_l2", &sim_stats_t::read_hits_l2},
+    {"read_misses_l2", &sim_stats_t::read_misses_l2},
+    {"writes_l2", &sim_stats_t::writes_l2},
+    {"write_backs", &sim_stats_t::write_backs_l1_or_victim_cache},
+    {"write_backs_l2", &sim_stats_t::write_backs_l2},
+    {"writes_dram", &sim_stats_t::writes_dram},
+    {"write_buffer_stalls", &sim_stats_t::write_buffer_stalls},
+};
+
+static const struct {
+    const char *name;
+    double sim_stats_t::*value;
+} STATS_VALUES[] = {
+    {"hit_ratio_l1", &sim_stats_t::hit_ratio_l1},
+    {"read_hit_ratio_l2", &sim_stats_t::read_hit_ratio_l2},
+    {"aat_l1", &sim_stats_t::avg_access_time_l1},
+    {"aat_l2", &sim_stats_t::avg_access_time_l2},
+    {"write_buffer_stall_cycles", &sim_stats_t::write_buffer_stall_cycles},
+    {"dram_write_bandwidth", &sim_stats_t::dram_write_bandwidth},
+};
+
+// Spins briefly, then gives up the CPU, until ready() holds. With patient,
+// sleeps rather than yields after a while, for the writer, which is idle
+// most of the time.
+template <typename Pred>
+static void wait_until(Pred ready, bool patient) {
+    for (int spins = 0; !ready(); spins++) {
+        if (patient && spins >= 1024) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        else if (spins >= 64) std::this_thread::yield();
+    }
+}
+
+StatsStream::StatsStream(FILE *out, stats_format_t format, bool threaded)
+    : out(out), format(format), slots(new stats_chunk_t[STATS_STREAM_SLOTS]),
+      threaded(threaded), closed(false), head(0), tail(0), failed(false) {
+    slots[0].size = 0;
+    if (threaded) {
+        writer = std::thread(&StatsStream::consume, this);
+    }
+    if (format == STATS_FORMAT_CSV) {
+        char line[512];
+        int n = snprintf(line, sizeof line, "records");
+        for (const auto &column : STATS_COUNTS) {
+            n += snprintf(line + n, sizeof line - n, ",%s", column.name);
+        }
+        for (const auto &column : STATS_VALUES) {
+            n += snprintf(line + n, sizeof line - n, ",%s", column.name);
+        }
+        n += snprintf(line + n, sizeof line - n, "\n");
+        append(line, n);
+    }
+}
+
+StatsStream::~StatsStream() {
+    close();
+    delete[] slots;
+}
+
+void StatsStream::write(uint64_t records, const sim_stats_t &delta) {
+    bool json = format == STATS_FORMAT_JSON;
+    char line[1024];
+    int n = snprintf(line, sizeof line, json ? "{\"records\": %" PRIu64 : "%" PRIu64, records);
+    for (const auto &column : STATS_COUNTS) {
+        n += snprintf(line + n, sizeof line - n, json ? ", \"%s\": %" PRIu64 : ",%.0s%" PRIu64,
+                      column.name, delta.*column.count);
+    }
+    for (const auto &column : STATS_VALUES) {
+        // A ratio with nothing to divide, such as L2's when no read got that
+        // far, is null in JSON and an empty field in CSV. The AATs are
+        // always defined: an interval that never missed L1 gets its hit time.
+        double value = delta.*column.value;
+        if (isfinite(value)) {
+            n += snprintf(line + n, sizeof line - n, json ? ", \"%s\": %.6f" : ",%.0s%.6f", column.name, value);
+        }
+        else {
+            n += snprintf(line + n, sizeof line - n, json ? ", \"%s\": null" : ",%.0s", column.name);
+        }
+    }
+    n += snprintf(line + n, sizeof line - n, json ? "}\n" : "\n");
+    append(line, n);
+}
+
+void StatsStream::append(const char *text, size_t size) {
+    stats_chunk_t *chunk = &slots[head.load(std::memory_order_relaxed) % STATS_STREAM_SLOTS];
+    if (chunk->size + size > STATS_CHUNK_SIZE) {
+        publish();
+        chunk = &slots[head.load(std::memory_order_relaxed) % STATS_STREAM_SLOTS];
+    }
+    memcpy(chunk->data + chunk->size, text, size);
+    chunk->size += size;
+}
+
+// Hands the chunk being filled to the writer and starts the next one. An
+// empty chunk tells the writer to finish.
+void StatsStream::publish() {
+    if (!threaded) {
+        if (fwrite(slots[0].data, 1, slots[0].size, out) != slots[0].size) {
+            failed = true;
+        }
+        slots[0].size = 0;
+        return;
+    }
+    size_t i = head.load(std::memory_order_relaxed);
+    head.store(++i, std::memory_order_release);
+    wait_until([&] { return i - tail.load(std::memory_order_acquire) < STATS_STREAM_SLOTS; }, false);
+    slots[i % STATS_STREAM_SLOTS].size = 0;
+}
+
+// Writer thread
+void StatsStream::consume() {
+    for (size_t i = 0;; i++) {
+        wait_until([&] { return head.load(std::memory_order_acquire) != i; }, true);
+        stats_chunk_t *chunk = &slots[i % STATS_STREAM_SLOTS];
+        if (!chunk->size) {
+            return;
+        }
+        if (fwrite(chunk->data, 1, chunk->size, out) != chunk->size) {
+            failed = true;
+        }
+        tail.store(i + 1, std::memory_order_release);
+    }
+}
+
+int StatsStream::close() {
+    if (closed) {
+        return failed;
+    }
+    closed = true;
+    if (slots[head.load(std::memory_order_relaxed) % STATS_STREAM_SLOTS].size) {
+        publish();
+    }
+    if (threaded) {
+        // The end marker
+        publish();
+        writer.join();
+    }
+    if (fflush(out)) {
+        failed = true;
+    }
+    return failed;
+}
@@ -0,0 +1,63 @@
+#ifndef STATS_STREAM_HPP
+#define STATS_STREAM_HPP
+
+#include "cachesim.hpp"
+#include <stdio.h>
+#include <atomic>
+#include <thread>
+
+typedef enum stats_format {
+    // One JSON object per line (JSON Lines)
+    STATS_FORMAT_JSON,
+    // A header row, then one row per interval
+    STATS_FORMAT_CSV,
+} stats_format_t;
+
+// Bytes of formatted statistics handed to the writer at a time
+static const size_t STATS_CHUNK_SIZE = 1 << 16;
+// Chunks in flight between the simulator and the writer
+static const size_t STATS_STREAM_SLOTS = 8;
+
+typedef struct stats_chunk {
+    char data[STATS_CHUNK_SIZE];
+    size_t size;
+} stats_chunk_t;
+
+// Interval statistics for --stats-interval. Rows are formatted on the
+// simulation thread into chunks, and full chunks pass to a writer thread
+// through a single-producer/single-consumer ring like TracePipeline's, so
+// the simulator only waits on the file once every slot is still queued.
+class StatsStream {
+public:
+    // out stays open and belongs to the caller. Without threaded, full
+    // chunks are written in line.
+    StatsStream(FILE *out, stats_format_t format, bool threaded);
+    ~StatsStream();
+
+    // One interval ending after records trace records. delta holds the
+    // interval's counts, with the ratios and AATs already worked out by
+    // sim_finish().
+    void write(uint64_t records, const sim_stats_t &delta);
+    // Writes out everything queued and stops the writer. Returns nonzero if
+    // any of it could not be written.
+    int close();
+
+private:
+    void append(const char *text, size_t size);
+    void publish();
+    void consume();
+
+    FILE *out;
+    stats_format_t format;
+    stats_chunk_t *slots;
+    bool threaded;
+    bool closed;
+    // Chunks published by the simulator and released by the writer, as in
+    // TracePipeline. Slot head % STATS_STREAM_SLOTS is being filled.
+    std::atomic<size_t> head;
+    std::atomic<size_t> tail;
+    std::atomic<bool> failed;
+    std::thread writer;
+};
+
+#endif /* STATS_STREAM_HPP */
@@ -0,0 +1,137 @@
+#include "tag_lookup.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define TAG_LOOKUP_X86 1
+#endif
+
+static int tag_find_scalar_fn(const uint64_t *tags, int n, uint64_t tag) {
+    return tag_find_scalar(tags, n, tag);
+}
+
+// The vector versions compare whole sets of 4 to 32 ways before testing for
+// a match, so a full set costs one hard-to-predict branch however wide it
+// is. Partially filled sets and other widths go a chunk at a time.
+
+#if defined(TAG_LOOKUP_X86) && defined(__SSE2__)
+// SSE2 has no 64-bit compare: both 32-bit halves of a lane have to match.
+// Returns one bit per way of the pair, in bits 0 and 1.
+static inline unsigned sse2_match2(const uint64_t *tags, __m128i key) {
+    __m128i eq = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *)tags), key);
+    // Swap the halves of each lane and AND, so a lane is all ones only if
+    // both halves matched
+    eq = _mm_and_si128(eq, _mm_shuffle_epi32(eq, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_movemask_pd(_mm_castsi128_pd(eq));
+}
+
+template <int N>
+static inline uint32_t sse2_match(const uint64_t *tags, __m128i key) {
+    uint32_t m = 0;
+    for (int w = 0; w < N; w += 2) {
+        m |= sse2_match2(tags + w, key) << w;
+    }
+    return m;
+}
+
+static int tag_find_sse2(const uint64_t *tags, int n, uint64_t tag) {
+    const __m128i key = _mm_set1_epi64x(tag);
+    uint32_t m;
+    switch (n) {
+    case 4:  m = sse2_match<4>(tags, key); break;
+    case 8:  m = sse2_match<8>(tags, key); break;
+    case 16: m = sse2_match<16>(tags, key); break;
+    case 32: m = sse2_match<32>(tags, key); break;
+    default:
+        int w = 0;
+        for (; w + 2 <= n; w += 2) {
+            unsigned pair = sse2_match2(tags + w, key);
+            if (pair) return w + __builtin_ctz(pair);
+        }
+        if (w < n && tags[w] == tag) return w;
+        return -1;
+    }
+    return m ? __builtin_ctz(m) : -1;
+}
+#endif
+
+#if defined(TAG_LOOKUP_X86)
+__attribute__((target("avx2")))
+static inline unsigned avx2_match4(const uint64_t *tags, __m256i key) {
+    __m256i eq = _mm256_cmpeq_epi64(_mm256_loadu_si256((const __m256i *)tags), key);
+    return _mm256_movemask_pd(_mm256_castsi256_pd(eq));
+}
+
+template <int N>
+__attribute__((target("avx2")))
+static inline uint32_t avx2_match(const uint64_t *tags, __m256i key) {
+    uint32_t m = 0;
+    for (int w = 0; w < N; w += 4) {
+        m |= avx2_match4(tags + w, key) << w;
+    }
+    return m;
+}
+
+__attribute__((target("avx2")))
+static int tag_find_avx2(const uint64_t *tags, int n, uint64_t tag) {
+    const __m256i key = _mm256_set1_epi64x(tag);
+    uint32_t m;
+    switch (n) {
+    case 4:  m = avx2_match<4>(tags, key); break;
+    case 8:  m = avx2_match<8>(tags, key); break;
+    case 16: m = avx2_match<16>(tags, key); break;
+    case 32: m = avx2_match<32>(tags, key); break;
+    default:
+        int w = 0;
+        for (; w + 4 <= n; w += 4) {
+            unsigned quad = avx2_match4(tags + w, key);
+            if (quad) return w + __builtin_ctz(quad);
+        }
+        for (; w < n; w++) {
+            if (tags[w] == tag) return w;
+        }
+        return -1;
+    }
+    return m ? __builtin_ctz(m) : -1;
+}
+#endif
+
+typedef struct tag_find_table {
+    tag_find_impl_t impls[3];
+    size_t count;
+} tag_find_table_t;
+
+static tag_find_table_t detect(void) {
+    tag_find_table_t table;
+    size_t n = 0;
+    table.impls[n++] = {"scalar", tag_find_scalar_fn, 1, 1};
+#if defined(TAG_LOOKUP_X86) && defined(__SSE2__)
+    table.impls[n++] = {"sse2", tag_find_sse2, 1, 0};
+#endif
+#if defined(TAG_LOOKUP_X86)
+    __builtin_cpu_init();
+    table.impls[n++] = {"avx2", tag_find_avx2, __builtin_cpu_supports("avx2"), 1};
+#endif
+    table.count = n;
+    return table;
+}
+
+const tag_find_impl_t *tag_find_impls(size_t *count) {
+    // Detected on first use; static initialization is thread-safe
+    static const tag_find_table_t table = detect();
+    *count = table.count;
+    return table.impls;
+}
+
+tag_find_fn tag_find_select(int ways) {
+    if (ways < TAG_FIND_MIN_SIMD_WAYS) {
+        return tag_find_scalar_fn;
+    }
+    size_t count;
+    const tag_find_impl_t *impls = tag_find_impls(&count);
+    for (size_t i = count; i-- > 0; ) {
+        if (impls[i].supported && impls[i].selectable) {
+            return impls[i].find;
+        }
+    }
+    return tag_find_scalar_fn;
+}
@@ -0,0 +1,41 @@
+#ifndef TAG_LOOKUP_HPP
+#define TAG_LOOKUP_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Tag search over one set. A set's tags are contiguous uint64s and its valid
+// ways are always the prefix [0, n), so validity is the lane mask of the
+// first n ways rather than a flag per block. Returns the first way in [0, n)
+// holding tag, or -1.
+typedef int (*tag_find_fn)(const uint64_t *tags, int n, uint64_t tag);
+
+typedef struct tag_find_impl {
+    const char *name;
+    tag_find_fn find;
+    // Nonzero when this CPU can run it
+    int supported;
+    // Whether tag_find_select() may pick it. SSE2 lacks a 64-bit compare
+    // and loses to the scalar loop at every width lookup-bench measures, so
+    // it is only there to be benchmarked.
+    int selectable;
+} tag_find_impl_t;
+
+// Below this many ways the scalar loop wins and is inlined instead
+static const int TAG_FIND_MIN_SIMD_WAYS = 8;
+
+static inline int tag_find_scalar(const uint64_t *tags, int n, uint64_t tag) {
+    for (int w = 0; w < n; w++) {
+        if (tags[w] == tag) return w;
+    }
+    return -1;
+}
+
+// Every implementation built into this binary, scalar first, widest last
+extern const tag_find_impl_t *tag_find_impls(size_t *count);
+
+// The widest selectable implementation this CPU supports for sets of the
+// given width, detected once at startup: AVX2 when present, else scalar
+extern tag_find_fn tag_find_select(int ways);
+
+#endif /* TAG_LOOKUP_HPP */
@@ -0,0 +1,158 @@
+#include "timing.hpp"
+#include "trace.hpp"
+#include <string.h>
+#include <algorithm>
+
+void MshrFile::init(unsigned entries) {
+    events = decltype(events)();
+    blocks.clear();
+    this->entries = entries;
+}
+
+// Retires the miss that completes first
+void MshrFile::pop() {
+    auto found = blocks.find(events.top().second);
+    if (found != blocks.end() && found->second == events.top().first) {
+        blocks.erase(found);
+    }
+    events.pop();
+}
+
+double MshrFile::in_flight(uint64_t block, double now) {
+    while (!events.empty() && events.top().first <= now) {
+        pop();
+    }
+    auto found = blocks.find(block);
+    return found == blocks.end() ? -1 : found->second;
+}
+
+double MshrFile::free_at(double now) {
+    while (!events.empty() && events.top().first <= now) {
+        pop();
+    }
+    if (events.size() < entries) {
+        return now;
+    }
+    double free = events.top().first;
+    pop();
+    return free;
+}
+
+void MshrFile::add(uint64_t block, double ready) {
+    events.push(event_t(ready, block));
+    blocks[block] = ready;
+}
+
+void TimingModel::setup(const sim_config_t &config, const timing_config_t &timing) {
+    this->timing = timing;
+    memset(&totals, 0, sizeof totals);
+    mshrs_l1.init(timing.mshrs_l1);
+    mshrs_l2.init(timing.mshrs_l2);
+    bank_free.assign((size_t)timing.dram_channels * timing.dram_banks, 0);
+    channel_free.assign(timing.dram_channels, 0);
+    l2_enabled = !config.l2_config.disabled;
+    early_restart = l2_enabled && config.l2_config.enable_ER;
+    // L1 and L2 share the block size
+    block_offset_bits = config.l1_config.b;
+    block_offset_mask = ((uint64_t)1 << block_offset_bits) - 1;
+    hit_time_l1 = L1_HIT_TIME_CONST + (config.l1_config.s * L1_HIT_TIME_PER_S);
+    hit_time_l2 = L2_HIT_TIME_CONST + (config.l2_config.s * L2_HIT_TIME_PER_S);
+    transfer_time = DRAM_AT_PER_WORD * ((uint64_t)1 << block_offset_bits) / WORD_SIZE;
+    core_time = 0;
+    covered_until = 0;
+}
+
+// A block read from DRAM arriving at cycle arrival. Returns when the word
+// asked for is back, which is the end of the transfer unless early restart
+// is on, and sets *fill_done to the end.
+double TimingModel::dram_read(uint64_t block, uint64_t addr, double arrival, double *fill_done) {
+    unsigned channel = block % timing.dram_channels;
+    double *bank = &bank_free[channel * timing.dram_banks + (block / timing.dram_channels) % timing.dram_banks];
+    double start = std::max(arrival, *bank);
+    totals.dram_bank_wait_cycles += start - arrival;
+    double transfer = std::max(start + DRAM_AT, channel_free[channel]);
+    totals.dram_channel_wait_cycles += transfer - (start + DRAM_AT);
+    *fill_done = *bank = channel_free[channel] = transfer + transfer_time;
+    if (early_restart) {
+        return transfer + DRAM_AT_PER_WORD * ((addr & block_offset_mask) / (uint64_t)WORD_SIZE);
+    }
+    return *fill_done;
+}
+
+void TimingModel::access(char rw, uint64_t addr, uint64_t cycle, sim_stats_t *stats) {
+    uint64_t hits_l1 = stats->hits_l1;
+    uint64_t hits_victim_cache = stats->hits_victim_cache;
+    uint64_t reads_l2 = stats->reads_l2;
+    uint64_t read_hits_l2 = stats->read_hits_l2;
+    double write_buffer_stall = stats->write_buffer_stall_cycles;
+    sim_access(rw, addr, stats);
+
+    double issue = cycle != TRACE_NO_CYCLE ? std::max((double)cycle, core_time) : core_time;
+    double now = issue + (stats->write_buffer_stall_cycles - write_buffer_stall);
+    totals.write_buffer_stall_cycles += now - issue;
+    uint64_t block = addr >> block_offset_bits;
+    double ready;
+    double pending = mshrs_l1.in_flight(block, now);
+    if (pending >= 0) {
+        totals.merges_l1++;
+        ready = std::max(pending, now + hit_time_l1);
+    }
+    else if (stats->hits_l1 != hits_l1 || stats->hits_victim_cache != hits_victim_cache
+             || stats->reads_l2 == reads_l2) {
+        // Served by L1 or the victim cache, or a write that L1 passes on
+        // without allocating
+        ready = now + hit_time_l1;
+    }
+    else {
+        double free = mshrs_l1.free_at(now);
+        if (free > now) {
+            totals.mshr_stalls_l1++;
+            totals.mshr_stall_cycles_l1 += free - now;
+            now = free;
+        }
+        double fill_done;
+        if (!l2_enabled) {
+            ready = dram_read(block, addr, now + hit_time_l1, &fill_done);
+        }
+        else if (stats->read_hits_l2 != read_hits_l2) {
+            ready = now + hit_time_l1 + hit_time_l2;
+        }
+        else {
+            double arrival = now + hit_time_l1 + hit_time_l2;
+            pending = mshrs_l2.in_flight(block, arrival);
+            if (pending >= 0) {
+                totals.merges_l2++;
+                ready = pending;
+            }
+            else {
+                double start = mshrs_l2.free_at(arrival);
+                if (start > arrival) {
+                    totals.mshr_waits_l2++;
+                    totals.mshr_wait_cycles_l2 += start - arrival;
+                }
+                ready = dram_read(block, addr, start, &fill_done);
+                mshrs_l2.add(block, fill_done);
+            }
+        }
+        mshrs_l1.add(block, ready);
+
+        // Misses start in issue order, so the cycles covered by one grow at
+        // the end only
+        totals.miss_latency_sum += ready - now;
+        if (ready > covered_until) {
+            totals.miss_cycles += ready - std::max(now, covered_until);
+            covered_until = ready;
+        }
+    }
+
+    totals.accesses++;
+    totals.latency_sum += ready - issue;
+    totals.cycles = std::max(totals.cycles, ready);
+    core_time = now + (cycle != TRACE_NO_CYCLE ? 0 : timing.issue_cycles);
+}
+
+void TimingModel::finish(timing_stats_t *stats) {
+    *stats = totals;
+    stats->avg_latency = totals.accesses ? totals.latency_sum / totals.accesses : 0;
+    stats->mlp = totals.miss_cycles > 0 ? totals.miss_latency_sum / totals.miss_cycles : 0;
+}
@@ -0,0 +1,122 @@
+#ifndef TIMING_HPP
+#define TIMING_HPP
+
+#include "cachesim.hpp"
+#include <functional>
+#include <queue>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+typedef struct timing_config {
+    // Cycles between records that do not give their own issue cycle
+    double issue_cycles;
+    // Misses each level keeps in flight at once
+    unsigned mshrs_l1;
+    unsigned mshrs_l2;
+    // DRAM channels, and banks on each
+    unsigned dram_channels;
+    unsigned dram_banks;
+} timing_config_t;
+
+static const timing_config_t DEFAULT_TIMING_CONFIG = {
+    /*.issue_cycles =*/ 1,
+    /*.mshrs_l1 =*/ 8,
+    /*.mshrs_l2 =*/ 16,
+    /*.dram_channels =*/ 1,
+    /*.dram_banks =*/ 8,
+};
+
+typedef struct timing_stats {
+    uint64_t accesses;
+    // When the last access completed
+    double cycles;
+    // Issue to completion, summed over every access and over L1 misses
+    double latency_sum;
+    double miss_latency_sum;
+    // Cycles with at least one L1 miss in flight
+    double miss_cycles;
+    // Secondary misses that joined a miss already in flight
+    uint64_t merges_l1;
+    uint64_t merges_l2;
+    // L1 misses that found every MSHR busy, stalling the core, and L2 misses
+    // that waited for one
+    uint64_t mshr_stalls_l1;
+    double mshr_stall_cycles_l1;
+    uint64_t mshr_waits_l2;
+    double mshr_wait_cycles_l2;
+    // DRAM reads waiting on a busy bank, then on a busy channel
+    double dram_bank_wait_cycles;
+    double dram_channel_wait_cycles;
+    // Core stalls on a full write buffer, see --write-buffer
+    double write_buffer_stall_cycles;
+    // Filled in by finish()
+    double avg_latency;
+    double mlp;
+} timing_stats_t;
+
+// Outstanding misses of one level, keyed by block. Completions wait in a
+// min-heap, the event queue, and retire as time passes them.
+class MshrFile {
+public:
+    void init(unsigned entries);
+    // When the miss in flight on block completes, or -1 if there is none at
+    // cycle now
+    double in_flight(uint64_t block, double now);
+    // The first cycle from now with an entry free
+    double free_at(double now);
+    void add(uint64_t block, double ready);
+
+private:
+    void pop();
+
+    typedef std::pair<double, uint64_t> event_t;
+    std::priority_queue<event_t, std::vector<event_t>, std::greater<event_t>> events;
+    std::unordered_map<uint64_t, double> blocks;
+    unsigned entries;
+};
+
+// Times the trace on top of the functional simulator, for --timing. Each
+// record goes through sim_access() first; the counters it moves tell where
+// the access was served, and the model works out when. Records issue in
+// order, at the cycle they give or issue_cycles after the last, and the core
+// only stalls when a miss finds every L1 MSHR busy: misses overlap as far as
+// the MSHRs and the DRAM banks and channels let them. A block with a miss in
+// flight is a secondary miss that waits for it, even where the functional
+// model, which fills at once, saw a hit.
+//
+// A DRAM read occupies its bank for the access time, then its channel for
+// the transfer; the bank is free again once the block is out. Blocks
+// interleave across channels, then banks. DRAM writes are posted through
+// the write buffer and only cost the core its stalls.
+class TimingModel {
+public:
+    void setup(const sim_config_t &config, const timing_config_t &timing);
+    // Simulates one record, issued no earlier than cycle unless that is
+    // TRACE_NO_CYCLE
+    void access(char rw, uint64_t addr, uint64_t cycle, sim_stats_t *stats);
+    void finish(timing_stats_t *stats);
+
+private:
+    double dram_read(uint64_t block, uint64_t addr, double arrival, double *fill_done);
+
+    timing_config_t timing;
+    timing_stats_t totals;
+    MshrFile mshrs_l1;
+    MshrFile mshrs_l2;
+    std::vector<double> bank_free;
+    std::vector<double> channel_free;
+    bool l2_enabled;
+    bool early_restart;
+    uint64_t block_offset_bits;
+    uint64_t block_offset_mask;
+    double hit_time_l1;
+    double hit_time_l2;
+    double transfer_time;
+    // The cycle the next record issues at, at the earliest
+    double core_time;
+    // The end of the latest miss, for the cycles with one in flight
+    double covered_until;
+};
+
+#endif /* TIMING_HPP */
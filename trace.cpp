@@ -0,0 +1,295 @@
+#include "trace.hpp"
+#include "shm_ring.hpp"
+#include <errno.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+
+static_assert(sizeof(trace_header_t) == TRACE_HEADER_SIZE, "trace header layout");
+
+void trace_make_header(trace_header_t *header, trace_encoding_t encoding, uint64_t records) {
+    memset(header, 0, sizeof *header);
+    memcpy(header->magic, TRACE_MAGIC, sizeof header->magic);
+    header->version = TRACE_VERSION;
+    header->encoding = encoding;
+    header->records = records;
+}
+
+// Maps fd if it is a regular file holding a binary trace. Returns 1 when the
+// trace was mapped, 0 when fd should be read as text and -1 on a bad header.
+static int trace_map(trace_file_t *trace, int fd, const char *name) {
+    struct stat st;
+    if (fstat(fd, &st) || !S_ISREG(st.st_mode) || (size_t)st.st_size < TRACE_HEADER_SIZE) {
+        return 0;
+    }
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+        return 0;
+    }
+    trace_header_t header;
+    memcpy(&header, map, sizeof header);
+    if (memcmp(header.magic, TRACE_MAGIC, sizeof header.magic)) {
+        munmap(map, st.st_size);
+        return 0;
+    }
+
+    uint64_t payload = st.st_size - TRACE_HEADER_SIZE;
+    if (header.version != TRACE_VERSION
+        || (header.encoding != TRACE_ENCODING_FIXED && header.encoding != TRACE_ENCODING_VARINT)
+        || (header.encoding == TRACE_ENCODING_FIXED && payload / 8 < header.records)) {
+        printf("Invalid binary trace header in %s\n", name);
+        munmap(map, st.st_size);
+        return -1;
+    }
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+    trace->map = (const uint8_t *)map;
+    trace->map_size = st.st_size;
+    trace->begin = trace->map + TRACE_HEADER_SIZE;
+    trace->end = trace->map + st.st_size;
+    trace->encoding = header.encoding;
+    trace->records = header.records;
+    trace_rewind(trace);
+    return 1;
+}
+
+int trace_open(trace_file_t *trace, const char *path) {
+    memset(trace, 0, sizeof *trace);
+    if (!path) {
+        int mapped = trace_map(trace, STDIN_FILENO, "stdin");
+        if (mapped < 0) return 1;
+        if (!mapped) trace->text = stdin;
+        return 0;
+    }
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        printf("Could not open trace `%s'\n", path);
+        return 1;
+    }
+    int mapped = trace_map(trace, fd, path);
+    if (mapped) {
+        // The mapping outlives the descriptor
+        close(fd);
+        return mapped < 0;
+    }
+    trace->text = fdopen(fd, "r");
+    if (!trace->text) {
+        printf("Could not open trace `%s'\n", path);
+        close(fd);
+        return 1;
+    }
+    return 0;
+}
+
+int trace_buffer_append(trace_buffer_t *buffer, char rw, uint64_t addr) {
+    if (buffer->capacity - buffer->size < TRACE_MAX_RECORD_SIZE) {
+        size_t capacity = buffer->capacity ? 2 * buffer->capacity : 1 << 20;
+        uint8_t *grown = (uint8_t *)realloc(buffer->data, capacity);
+        if (!grown) {
+            return 1;
+        }
+        buffer->data = grown;
+        buffer->capacity = capacity;
+    }
+    buffer->size += trace_encode_record(TRACE_ENCODING_VARINT, rw, addr, buffer->prev_addr,
+                                        buffer->data + buffer->size);
+    buffer->prev_addr = addr;
+    buffer->records++;
+    return 0;
+}
+
+void trace_buffer_free(trace_buffer_t *buffer) {
+    free(buffer->data);
+    memset(buffer, 0, sizeof *buffer);
+}
+
+void trace_buffer_clear(trace_buffer_t *buffer) {
+    buffer->size = 0;
+    buffer->records = 0;
+    buffer->prev_addr = 0;
+}
+
+void trace_buffer_reader(const trace_buffer_t *buffer, trace_file_t *trace) {
+    memset(trace, 0, sizeof *trace);
+    trace->begin = buffer->data;
+    trace->end = buffer->data + buffer->size;
+    trace->encoding = TRACE_ENCODING_VARINT;
+    trace->records = buffer->records;
+    trace_rewind(trace);
+}
+
+int trace_load(trace_file_t *trace) {
+    if (!trace->text) {
+        return 0;
+    }
+
+    trace_buffer_t buffer;
+    memset(&buffer, 0, sizeof buffer);
+    char rw;
+    uint64_t addr;
+    while (trace_next(trace, &rw, &addr)) {
+        if (trace_buffer_append(&buffer, rw, addr)) {
+            printf("Out of memory loading the trace\n");
+            trace_buffer_free(&buffer);
+            return 1;
+        }
+    }
+
+    if (trace->text != stdin) {
+        fclose(trace->text);
+    }
+    trace_buffer_reader(&buffer, trace);
+    // The loaded trace owns the buffer from here on
+    trace->map = buffer.data;
+    trace->map_size = buffer.capacity;
+    trace->heap = true;
+    return 0;
+}
+
+bool trace_next_timed(trace_file_t *trace, char *rw, uint64_t *addr, uint64_t *cycle) {
+    *cycle = TRACE_NO_CYCLE;
+    if (!trace->text) {
+        return trace_next(trace, rw, addr);
+    }
+    char line[128];
+    while (fgets(line, sizeof line, trace->text)) {
+        int fields = sscanf(line, " %c 0x%" SCNx64 " %" SCNu64, rw, addr, cycle);
+        if (fields >= 2) {
+            if (fields == 2) *cycle = TRACE_NO_CYCLE;
+            return true;
+        }
+    }
+    return false;
+}
+
+void trace_rewind(trace_file_t *trace) {
+    if (trace->text) {
+        rewind(trace->text);
+    }
+    trace->cursor = trace->begin;
+    trace->remaining = trace->records;
+    trace->prev_addr = 0;
+}
+
+uint64_t trace_skip(trace_file_t *trace, uint64_t n) {
+    if (!trace->text && !trace->ring && trace->encoding == TRACE_ENCODING_FIXED) {
+        n = std::min<uint64_t>(n, std::min<uint64_t>(trace->remaining, (trace->end - trace->cursor) / 8));
+        trace->cursor += 8 * n;
+        trace->remaining -= n;
+        return n;
+    }
+    char rw;
+    uint64_t addr;
+    uint64_t skipped = 0;
+    while (skipped < n && trace_next(trace, &rw, &addr)) {
+        skipped++;
+    }
+    return skipped;
+}
+
+void trace_close(trace_file_t *trace) {
+    if (trace->heap) {
+        free((void *)trace->map);
+    }
+    else if (trace->map) {
+        munmap((void *)trace->map, trace->map_size);
+    }
+    if (trace->text && trace->text != stdin) {
+        fclose(trace->text);
+    }
+    if (trace->ring) {
+        munmap(trace->ring, shm_ring_size(trace->ring->capacity));
+    }
+    memset(trace, 0, sizeof *trace);
+}
+
+// Backs off from spinning to sleeping, for waits on another process
+static void ring_pause(int spins) {
+    if (spins >= 1024) std::this_thread::sleep_for(std::chrono::microseconds(100));
+    else if (spins >= 64) std::this_thread::yield();
+}
+
+int trace_open_shm(trace_file_t *trace, const char *name) {
+    memset(trace, 0, sizeof *trace);
+    char path[256];
+    if (shm_ring_path(name, path, sizeof path)) {
+        printf("Shared memory ring name `%s' is too long\n", name);
+        return 1;
+    }
+    int fd;
+    for (int spins = 0; (fd = shm_open(path, O_RDWR, 0)) < 0; spins++) {
+        if (errno != ENOENT) {
+            printf("Could not open shared memory ring `%s'\n", path);
+            return 1;
+        }
+        ring_pause(spins);
+    }
+    // The producer sizes the object before it sets ready
+    struct stat st;
+    for (int spins = 0; !fstat(fd, &st) && (size_t)st.st_size < sizeof(shm_ring_t); spins++) {
+        ring_pause(spins);
+    }
+    void *map = (size_t)st.st_size < sizeof(shm_ring_t) ? MAP_FAILED
+        : mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        printf("Could not map shared memory ring `%s'\n", path);
+        return 1;
+    }
+    shm_ring_t *ring = (shm_ring_t *)map;
+    for (int spins = 0; !ring->ready.load(std::memory_order_acquire); spins++) {
+        ring_pause(spins);
+    }
+    if (memcmp(ring->magic, SHM_RING_MAGIC, sizeof ring->magic) || ring->version != SHM_RING_VERSION
+        || !ring->capacity || (ring->capacity & (ring->capacity - 1))
+        || (size_t)st.st_size != shm_ring_size(ring->capacity)) {
+        printf("`%s' is not a cachesim shared memory ring\n", path);
+        munmap(map, st.st_size);
+        return 1;
+    }
+    // Free the name for the next run; both sides keep their mappings
+    shm_unlink(path);
+
+    trace->ring = ring;
+    trace->encoding = TRACE_ENCODING_FIXED;
+    trace->records = UINT64_MAX;
+    trace->remaining = UINT64_MAX;
+    trace->ring_tail = ring->tail.load(std::memory_order_relaxed);
+    trace->begin = trace->cursor = trace->end = (const uint8_t *)shm_ring_records(ring);
+    return 0;
+}
+
+bool trace_ring_wait(trace_file_t *trace) {
+    shm_ring_t *ring = trace->ring;
+    uint64_t tail = trace->ring_tail + (trace->end - trace->begin) / 8;
+    ring->tail.store(tail, std::memory_order_release);
+    uint64_t head;
+    for (int spins = 0; (head = ring->head.load(std::memory_order_acquire)) == tail; spins++) {
+        if (ring->closed.load(std::memory_order_acquire)) {
+            // The last records may have been published just before
+            head = ring->head.load(std::memory_order_acquire);
+            if (head == tail) return false;
+            break;
+        }
+        if (spins % 4096 == 4095 && kill(ring->producer_pid, 0) && errno == ESRCH) {
+            printf("The producer of the shared memory ring exited without closing it\n");
+            return false;
+        }
+        ring_pause(spins);
+    }
+    // Hand records back a quarter of the ring at a time, so the producer
+    // can carry on while these are read
+    uint64_t capacity = ring->capacity;
+    uint64_t offset = tail & (capacity - 1);
+    uint64_t n = std::min(std::min(head - tail, capacity - offset), capacity / 4 ? capacity / 4 : 1);
+    trace->ring_tail = tail;
+    trace->begin = trace->cursor = (const uint8_t *)(shm_ring_records(ring) + offset);
+    trace->end = trace->begin + 8 * n;
+    return true;
+}
@@ -0,0 +1,195 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+// Binary trace format
+//
+// A 32-byte header followed by the records. All fields are little-endian.
+//
+//   magic     8 bytes  "CSIMTRC\0"
+//   version   uint32   TRACE_VERSION
+//   encoding  uint32   trace_encoding_t
+//   records   uint64   number of records that follow
+//   reserved  uint64   zero
+//
+// TRACE_ENCODING_FIXED stores one uint64 per record: the address in bits
+// 0-62 and bit 63 set for a write. Records can be read straight out of the
+// mapping, but addresses must fit in 63 bits.
+//
+// TRACE_ENCODING_VARINT stores the signed distance from the previous address
+// (the first record is relative to 0), zig-zag encoded, as a little-endian
+// base-128 varint. The first byte carries the rw flag in bit 0 and six
+// payload bits in bits 1-6; later bytes carry seven payload bits each. Bit 7
+// of every byte is set when another byte follows. Traces with locality
+// shrink to one or two bytes per record.
+
+static const char TRACE_MAGIC[8] = {'C', 'S', 'I', 'M', 'T', 'R', 'C', '\0'};
+static const uint32_t TRACE_VERSION = 1;
+static const size_t TRACE_HEADER_SIZE = 32;
+// Longest varint record: 6 + 9 * 7 bits covers the 64-bit payload
+static const size_t TRACE_MAX_RECORD_SIZE = 10;
+
+typedef enum trace_encoding {
+    TRACE_ENCODING_FIXED,
+    TRACE_ENCODING_VARINT,
+} trace_encoding_t;
+
+typedef struct trace_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t encoding;
+    uint64_t records;
+    uint64_t reserved;
+} trace_header_t;
+
+typedef struct trace_file {
+    // Binary traces: the read-only mapping of the whole file, or a heap
+    // buffer when the trace was loaded from text by trace_load()
+    const uint8_t *map;
+    size_t map_size;
+    bool heap;
+    const uint8_t *begin;
+    uint64_t records;
+    const uint8_t *cursor;
+    const uint8_t *end;
+    uint32_t encoding;
+    uint64_t remaining;
+    uint64_t prev_addr;
+    // Text traces: the stream fscanf reads from
+    FILE *text;
+    // Shared-memory rings: the mapping, with [begin, end) the window of
+    // fixed-size records being read and ring_tail the index of the first
+    struct shm_ring *ring;
+    uint64_t ring_tail;
+} trace_file_t;
+
+// A growable in-memory varint trace
+typedef struct trace_buffer {
+    uint8_t *data;
+    size_t size;
+    size_t capacity;
+    uint64_t records;
+    uint64_t prev_addr;
+} trace_buffer_t;
+
+// Opens path, or stdin when path is NULL. A regular file that starts with
+// TRACE_MAGIC is memory-mapped; anything else is read as text. Returns
+// nonzero and prints a message on failure.
+extern int trace_open(trace_file_t *trace, const char *path);
+extern void trace_close(trace_file_t *trace);
+// Attaches to the shared-memory ring NAME (see shm_ring.hpp), waiting for a
+// producer to create it. The trace then ends when the producer closes the
+// ring, and cannot be loaded or rewound. Returns nonzero and prints a
+// message on failure.
+extern int trace_open_shm(trace_file_t *trace, const char *name);
+// Releases the window read so far to the producer and waits for the next
+// one. Returns false once the ring is closed and drained.
+extern bool trace_ring_wait(trace_file_t *trace);
+
+// Makes the trace replayable: text traces are parsed once into an in-memory
+// varint buffer, binary traces are already mapped. Afterwards a trace_file_t
+// can be copied by value and each copy rewound and read independently, which
+// is how several simulators share one trace. Returns nonzero on failure.
+extern int trace_load(trace_file_t *trace);
+// Back to the first record. A text trace that was not loaded is read again
+// from the start of its file, which fails quietly for pipes.
+extern void trace_rewind(trace_file_t *trace);
+// Skips up to n records, in constant time for fixed-size records. Returns
+// how many were skipped.
+extern uint64_t trace_skip(trace_file_t *trace, uint64_t n);
+
+// No issue cycle in the record, see trace_next_timed()
+static const uint64_t TRACE_NO_CYCLE = UINT64_MAX;
+
+// Like trace_next(), for the timing model. A text record may give the cycle
+// it issues at after the address, as in "R 0x1f40 5120"; *cycle is
+// TRACE_NO_CYCLE when it does not, and always for binary traces.
+extern bool trace_next_timed(trace_file_t *trace, char *rw, uint64_t *addr, uint64_t *cycle);
+
+// Appends a record. Returns nonzero when out of memory.
+extern int trace_buffer_append(trace_buffer_t *buffer, char rw, uint64_t addr);
+extern void trace_buffer_free(trace_buffer_t *buffer);
+// Empties the buffer, keeping its memory
+extern void trace_buffer_clear(trace_buffer_t *buffer);
+// Points trace at the records of buffer, which must outlive it. The trace
+// is not closed; it owns nothing.
+extern void trace_buffer_reader(const trace_buffer_t *buffer, trace_file_t *trace);
+
+// Writes a header for records encoded with encoding
+extern void trace_make_header(trace_header_t *header, trace_encoding_t encoding, uint64_t records);
+
+static inline uint64_t trace_zigzag(uint64_t delta) {
+    return (delta << 1) ^ (uint64_t)((int64_t)delta >> 63);
+}
+
+static inline uint64_t trace_unzigzag(uint64_t value) {
+    return (value >> 1) ^ (0 - (value & 1));
+}
+
+// Encodes one record into buf, which must hold TRACE_MAX_RECORD_SIZE bytes.
+// Returns the number of bytes written.
+static inline size_t trace_encode_record(trace_encoding_t encoding, char rw, uint64_t addr,
+                                         uint64_t prev_addr, uint8_t *buf) {
+    if (encoding == TRACE_ENCODING_FIXED) {
+        uint64_t word = addr | ((uint64_t)(rw == 'W') << 63);
+        for (int i = 0; i < 8; i++) {
+            buf[i] = word >> (8 * i);
+        }
+        return 8;
+    }
+    uint64_t value = trace_zigzag(addr - prev_addr);
+    size_t n = 0;
+    uint8_t byte = (rw == 'W') | ((value & 0x3f) << 1);
+    value >>= 6;
+    while (value) {
+        buf[n++] = byte | 0x80;
+        byte = value & 0x7f;
+        value >>= 7;
+    }
+    buf[n++] = byte;
+    return n;
+}
+
+// Decodes the next record. Returns false at the end of the trace.
+static inline bool trace_next(trace_file_t *trace, char *rw, uint64_t *addr) {
+    if (trace->text) {
+        while (!feof(trace->text)) {
+            if (fscanf(trace->text, "%c 0x%" SCNx64 "\n", rw, addr) == 2) return true;
+        }
+        return false;
+    }
+    if (!trace->remaining) return false;
+    if (trace->cursor >= trace->end && !(trace->ring && trace_ring_wait(trace))) return false;
+    const uint8_t *p = trace->cursor;
+    if (trace->encoding == TRACE_ENCODING_FIXED) {
+        uint64_t word;
+        memcpy(&word, p, sizeof word);
+        trace->cursor = p + 8;
+        *rw = (word >> 63) ? 'W' : 'R';
+        *addr = word & ~((uint64_t)1 << 63);
+    }
+    else {
+        uint8_t byte = *p++;
+        *rw = (byte & 1) ? 'W' : 'R';
+        uint64_t value = (byte >> 1) & 0x3f;
+        int shift = 6;
+        while ((byte & 0x80) && p < trace->end && shift < 64) {
+            byte = *p++;
+            value |= (uint64_t)(byte & 0x7f) << shift;
+            shift += 7;
+        }
+        trace->cursor = p;
+        trace->prev_addr += trace_unzigzag(value);
+        *addr = trace->prev_addr;
+    }
+    trace->remaining--;
+    return true;
+}
+
+#endif /* TRACE_HPP */
@@ -0,0 +1,74 @@
+#include "trace_pipeline.hpp"
+
+// Spins briefly, then gives up the CPU, until ready() holds
+template <typename Pred>
+static void wait_until(Pred ready) {
+    for (int spins = 0; !ready(); spins++) {
+        if (spins >= 64) std::this_thread::yield();
+    }
+}
+
+TracePipeline::TracePipeline(trace_file_t *trace, bool threaded)
+    : trace(trace), slots(new access_batch_t[TRACE_PIPELINE_SLOTS]),
+      threaded(threaded), head(0), tail(0), holding(false), finished(false) {
+    if (threaded) {
+        reader = std::thread(&TracePipeline::produce, this);
+    }
+}
+
+TracePipeline::~TracePipeline() {
+    if (threaded) {
+        // Drain whatever the reader still has to publish so it can finish
+        while (next()) { }
+        reader.join();
+    }
+    delete[] slots;
+}
+
+void TracePipeline::fill(access_batch_t *batch) {
+    size_t n = 0;
+    while (n < TRACE_BATCH_SIZE && trace_next(trace, &batch->records[n].rw, &batch->records[n].addr)) {
+        n++;
+    }
+    batch->count = n;
+}
+
+// Reader thread. An empty batch marks the end of the trace.
+void TracePipeline::produce() {
+    size_t i = 0;
+    for (;;) {
+        wait_until([&] { return i - tail.load(std::memory_order_acquire) < TRACE_PIPELINE_SLOTS; });
+        access_batch_t *batch = &slots[i % TRACE_PIPELINE_SLOTS];
+        fill(batch);
+        head.store(++i, std::memory_order_release);
+        if (!batch->count) {
+            return;
+        }
+    }
+}
+
+const access_batch_t *TracePipeline::next() {
+    if (!threaded) {
+        fill(&slots[0]);
+        return slots[0].count ? &slots[0] : NULL;
+    }
+
+    size_t i = tail.load(std::memory_order_relaxed);
+    if (holding) {
+        // Hand the previous batch back to the reader
+        tail.store(++i, std::memory_order_release);
+        holding = false;
+    }
+    if (finished) {
+        return NULL;
+    }
+    wait_until([&] { return head.load(std::memory_order_acquire) != i; });
+    access_batch_t *batch = &slots[i % TRACE_PIPELINE_SLOTS];
+    holding = true;
+    if (!batch->count) {
+        // The end marker; the reader has exited
+        finished = true;
+        return NULL;
+    }
+    return batch;
+}
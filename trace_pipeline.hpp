@@ -0,0 +1,53 @@
+#ifndef TRACE_PIPELINE_HPP
+#define TRACE_PIPELINE_HPP
+
+#include "cachesim.hpp"
+#include "trace.hpp"
+#include <atomic>
+#include <thread>
+
+// Records per batch handed to sim_access_batch()
+static const size_t TRACE_BATCH_SIZE = 4096;
+// Batches in flight between the reader and the simulator
+static const size_t TRACE_PIPELINE_SLOTS = 8;
+
+typedef struct access_batch {
+    access_t records[TRACE_BATCH_SIZE];
+    size_t count;
+} access_batch_t;
+
+// Reads a trace in batches on a thread of its own, so parsing text or
+// decoding varints overlaps with simulation. Filled batches pass to the
+// consumer through a single-producer/single-consumer ring: each side owns
+// one index and only ever publishes it with a release store, so there are
+// no locks and a full or empty ring is just a wait for the other side.
+class TracePipeline {
+public:
+    // trace belongs to the pipeline until it is destroyed. Without threaded
+    // the batches are read in line by next(), which is better on a single
+    // CPU where the reader would only compete with the simulator.
+    TracePipeline(trace_file_t *trace, bool threaded);
+    ~TracePipeline();
+
+    // The next batch, or NULL at the end of the trace. The batch stays
+    // valid until the following call.
+    const access_batch_t *next();
+
+private:
+    void fill(access_batch_t *batch);
+    void produce();
+
+    trace_file_t *trace;
+    access_batch_t *slots;
+    bool threaded;
+    // Batches published by the reader and released by the consumer. Both
+    // only grow; slot i % TRACE_PIPELINE_SLOTS holds batch i.
+    std::atomic<size_t> head;
+    std::atomic<size_t> tail;
+    // The consumer has a batch out, and has seen the end of the trace
+    bool holding;
+    bool finished;
+    std::thread reader;
+};
+
+#endif /* TRACE_PIPELINE_HPP */